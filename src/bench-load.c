@@ -0,0 +1,131 @@
+/*
+ * bench-load.c
+ * Load-time benchmark of the plugin (see --enable-fast-load): opens the
+ * built module N times the way libpeas does (g_module_open() and a lookup
+ * of peas_register_types), then registers its types once through a
+ * PeasObjectModule, and reports the wall time of each step and the
+ * Private_Dirty pages of the module read from /proc/self/smaps.
+ *   bench-load [N [DIR]]
+ * N defaults to 100 and DIR, the directory holding libtimer.so, to .libs
+ * (run from the build directory, or through 'make bench').
+ *
+ *   Copyright (C) 2013 Christopher A. Doyle
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License along
+ *   with this program; if not, write to the Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <gmodule.h>
+#include <libpeas/peas.h>
+
+#define MODULE_NAME "timer" /* libtimer.so */
+
+
+/* Sum of the Private_Dirty lines (kB) of the mappings of the file named name in /proc/self/smaps. */
+static gint64
+private_dirty(const gchar *name) {
+  gchar    *contents = NULL;
+  gchar   **lines    = NULL;
+  gboolean  ours     = FALSE;
+  gint64    total    = 0;
+  guint     i;
+
+  if (!g_file_get_contents("/proc/self/smaps", &contents, NULL, NULL)) {
+    return -1;
+  }
+
+  lines = g_strsplit(contents, "\n", -1);
+  for (i=0; lines[i]; i++) {
+    if (g_ascii_isxdigit(lines[i][0]) && strchr(lines[i], '-')) {
+      /* a mapping: "start-end perms offset dev inode path" */
+      ours = g_str_has_suffix(lines[i], name);
+    } else if (ours && g_str_has_prefix(lines[i], "Private_Dirty:")) {
+      total += g_ascii_strtoll(lines[i] + strlen("Private_Dirty:"), NULL, 10);
+    }
+  }
+
+  g_strfreev(lines);
+  g_free(contents);
+  return total;
+}
+
+
+int
+main(int argc, char *argv[]) {
+  guint             loads    = (argc > 1) ? (guint) atoi(argv[1]) : 100;
+  const gchar      *dir      = (argc > 2) ? argv[2] : ".libs";
+  gchar            *path     = NULL;
+  gchar            *name     = NULL;
+  GModule          *module   = NULL;
+  PeasObjectModule *peas     = NULL;
+  gpointer          symbol   = NULL;
+  gint64            start;
+  gint64            elapsed;
+  gint64            first    = 0;
+  gint64            total    = 0;
+  gint64            dirty    = 0;
+  guint             i;
+
+  if (loads < 1) {
+    g_printerr("usage: %s [N [DIR]]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  path = g_module_build_path(dir, MODULE_NAME);
+  name = g_path_get_basename(path);
+
+  for (i=0; i<loads; i++) {
+    start  = g_get_monotonic_time();
+    module = g_module_open(path, G_MODULE_BIND_LOCAL);
+    if (!module || !g_module_symbol(module, "peas_register_types", &symbol)) {
+      g_printerr("%s: %s\n", path, g_module_error());
+      return EXIT_FAILURE;
+    }
+    elapsed = g_get_monotonic_time() - start;
+
+    if (i == 0) {
+      first = elapsed;
+      dirty = private_dirty(name);
+    } else {
+      total += elapsed;
+    }
+    g_module_close(module); /* unloads it: the next open maps and relocates it again */
+  }
+
+  /* The types can be registered only once per process. */
+  start = g_get_monotonic_time();
+  peas  = peas_object_module_new(MODULE_NAME, dir, TRUE);
+  if (!g_type_module_use(G_TYPE_MODULE(peas))) {
+    g_printerr("%s: couldn't register the plugin\n", path);
+    return EXIT_FAILURE;
+  }
+  elapsed = g_get_monotonic_time() - start;
+
+  g_print("loads:         %u\n", loads);
+  g_print("first load:    %" G_GINT64_FORMAT " us\n", first);
+  if (loads > 1) {
+    g_print("later loads:   %" G_GINT64_FORMAT " us on average\n", total / (loads - 1));
+  }
+  g_print("registration:  %" G_GINT64_FORMAT " us (open and peas_register_types)\n", elapsed);
+  g_print("Private_Dirty: %" G_GINT64_FORMAT " kB (loaded, before registration), %" G_GINT64_FORMAT " kB (registered)\n",
+          dirty, private_dirty(name));
+
+  g_free(name);
+  g_free(path);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,173 @@
+/*
+ * bench-wakeups.c
+ * Wakeups-per-hour benchmark of the timer thread: runs a TimerEngine the
+ * way the plugin does in typical configurations (see the scenarios below),
+ * on a simulated clock (see timer-clock.h) that jumps to each deadline, so
+ * that an hour of use takes a moment.  The wakeups are read from the
+ * engine-wakeups metric and scaled to an hour.
+ * The tick source runs on the system clock, so it isn't simulated: while a
+ * timer runs, a tick listener adds one main-loop wakeup per second.  The
+ * timer slack doesn't change the counts either, only how the kernel batches
+ * the wakeups with those of other threads.
+ *
+ *   Copyright (C) 2013 Christopher A. Doyle
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License along
+ *   with this program; if not, write to the Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "config.h"
+
+#include <stdlib.h>
+
+#include "timer-clock.h"
+#include "timer-engine.h"
+#include "timer-metrics.h"
+#include "timer-schedule.h"
+
+#define FAKE_EPOCH (G_GINT64_CONSTANT(1381000000) * G_USEC_PER_SEC) /* wall-clock time at monotonic time 0 */
+
+/* A use of a TimerEngine by the plugin: re-armed for period upon each expiry. */
+typedef struct {
+  const gchar *name;
+  GTimeSpan    period;  /* time from arming to expiry */
+  GTimeSpan    warning; /* warning time, 0 for none */
+  gboolean     at;      /* armed for a wall-clock time (TIMER_COMMAND_ARM_AT) rather than a duration */
+} ScenarioType;
+
+static const ScenarioType scenarios[] = {
+  { "sleep timer, 30 minutes, re-armed",  30 * G_TIME_SPAN_MINUTE, 0,                      FALSE },
+  { "sleep timer with a 1 minute warning", 30 * G_TIME_SPAN_MINUTE, G_TIME_SPAN_MINUTE,     FALSE },
+  { "watchdog, Budget=30, playing",        30 * G_TIME_SPAN_SECOND, 0,                      FALSE },
+  { "dwell, 5 minute items",                5 * G_TIME_SPAN_MINUTE, 0,                      FALSE },
+  { "schedule, a switch every hour",       G_TIME_SPAN_HOUR,        TIMER_SCHEDULE_PREROLL, TRUE  }
+};
+
+/* The simulated clock, shared by the engine thread and the main thread. */
+static GMutex fakeMutex;
+static gint64 fakeNow = 0; /* monotonic time */
+
+
+static gint64
+fake_get_monotonic_time(gpointer user_data) {
+  gint64 now;
+
+  g_mutex_lock(&fakeMutex);
+  now = fakeNow;
+  g_mutex_unlock(&fakeMutex);
+  return now;
+}
+
+
+static gint64
+fake_get_real_time(gpointer user_data) {
+  return FAKE_EPOCH + fake_get_monotonic_time(user_data);
+}
+
+
+/* Nothing happens before the deadline but the deadline itself: jump to it. */
+static gboolean
+fake_wait_until(GCond *cond, GMutex *mutex, gint64 end_time, gpointer user_data) {
+  g_mutex_lock(&fakeMutex);
+  fakeNow = MAX(fakeNow, end_time);
+  g_mutex_unlock(&fakeMutex);
+  return FALSE;
+}
+
+static const TimerClockType fakeClock = {
+  fake_get_monotonic_time,
+  fake_get_real_time,
+  fake_wait_until
+};
+
+
+typedef struct {
+  const ScenarioType *scenario;
+  GMainLoop          *loop;
+  gint64              start; /* monotonic time the scenario started */
+} RunType;
+
+
+static void
+arm(TimerEngine *engine, const ScenarioType *scenario) {
+  if (scenario->at) {
+    timer_engine_command(engine, TIMER_COMMAND_ARM_AT, timer_engine_get_time(engine) + scenario->period);
+  } else {
+    timer_engine_command(engine, TIMER_COMMAND_ARM, scenario->period);
+  }
+}
+
+
+static void
+on_expired(TimerEngine *engine, RunType *run) {
+  if (fake_get_monotonic_time(NULL) - run->start >= G_TIME_SPAN_HOUR) {
+    g_main_loop_quit(run->loop);
+    return;
+  }
+  arm(engine, run->scenario);
+}
+
+
+static gint64
+engine_wakeups(void) {
+  GVariant *metrics = g_variant_ref_sink(timer_metrics_to_variant());
+  gint64    value   = 0;
+
+  g_variant_lookup(metrics, "engine-wakeups", "x", &value);
+  g_variant_unref(metrics);
+  return value;
+}
+
+
+/* Returns the wakeups of the timer thread per hour of scenario. */
+static gint64
+run_scenario(const ScenarioType *scenario) {
+  TimerEngine *engine = timer_engine_new();
+  RunType      run;
+  gint64       wakeups;
+  GTimeSpan    elapsed;
+
+  timer_engine_set_clock(engine, &fakeClock, NULL);
+  timer_engine_set_warning_time(engine, scenario->warning);
+  g_signal_connect(engine, "expired", G_CALLBACK(on_expired), &run);
+
+  run.scenario = scenario;
+  run.loop     = g_main_loop_new(NULL, FALSE);
+  run.start    = fake_get_monotonic_time(NULL);
+  wakeups      = engine_wakeups();
+
+  arm(engine, scenario);
+  g_main_loop_run(run.loop);
+
+  wakeups = engine_wakeups() - wakeups;
+  elapsed = fake_get_monotonic_time(NULL) - run.start;
+
+  g_signal_handlers_disconnect_by_data(engine, &run);
+  g_object_unref(engine);
+  g_main_loop_unref(run.loop);
+  return wakeups * G_TIME_SPAN_HOUR / elapsed;
+}
+
+
+int
+main(int argc, char *argv[]) {
+  guint i;
+
+  for (i=0; i<G_N_ELEMENTS(scenarios); i++) {
+    g_print("%-40s %4" G_GINT64_FORMAT " wakeups/hour\n", scenarios[i].name, run_scenario(&scenarios[i]));
+  }
+  g_print("%-40s %4d wakeups/hour (main loop, while a timer runs)\n", "tick listener", 3600);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,387 @@
+/*
+ * test-engine.c
+ * Tests of TimerEngine on a fake clock (see timer-clock.h): arming,
+ * expiry, warning, extension and cancellation while the wall clock steps
+ * forward and back, the monotonic clock stalls, or the machine is suspended
+ * (the wall clock goes on, the monotonic one doesn't).  Deadlines are kept
+ * in monotonic time, so none of these moves them: a wall-clock deadline is
+ * re-anchored on the kernel's notice of a step of the system clock (see
+ * update_clock_source() in timer-engine.c), which the fake clock never
+ * sends.
+ * The fake clock only moves when a test moves it; the timer thread polls it
+ * every FAKE_POLL of real time, so the whole suite runs in well under a
+ * second.
+ *
+ *   Copyright (C) 2013 Christopher A. Doyle
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License along
+ *   with this program; if not, write to the Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "config.h"
+
+#include "timer-clock.h"
+#include "timer-engine.h"
+
+#define FAKE_EPOCH (G_GINT64_CONSTANT(1381000000) * G_USEC_PER_SEC) /* wall-clock time the tests start at */
+#define FAKE_POLL  (G_TIME_SPAN_MILLISECOND)     /* real time between two looks of the timer thread at the clock */
+#define QUIET_TIME (20 * G_TIME_SPAN_MILLISECOND) /* real time an event that shouldn't happen is waited for */
+#define EVENT_TIME (G_TIME_SPAN_SECOND)           /* real time an event that should happen is waited for at most */
+
+typedef struct {
+  GMutex mutex;
+  gint64 monotonic;
+  gint64 real;
+} FakeClockType;
+
+typedef struct {
+  FakeClockType  clock;
+  TimerEngine   *engine;
+  guint          warnings;
+  guint          expiries;
+  guint          cancellations;
+} Fixture;
+
+
+static gint64
+fake_get_monotonic_time(FakeClockType *clock) {
+  gint64 now;
+
+  g_mutex_lock(&clock->mutex);
+  now = clock->monotonic;
+  g_mutex_unlock(&clock->mutex);
+  return now;
+}
+
+
+static gint64
+fake_get_real_time(FakeClockType *clock) {
+  gint64 now;
+
+  g_mutex_lock(&clock->mutex);
+  now = clock->real;
+  g_mutex_unlock(&clock->mutex);
+  return now;
+}
+
+
+/* Wait in real time for a short while, then look at the fake time again: returning TRUE for a wakeup
+   that wasn't a signal is allowed (spurious wakeup). */
+static gboolean
+fake_wait_until(GCond *cond, GMutex *mutex, gint64 end_time, FakeClockType *clock) {
+  if (fake_get_monotonic_time(clock) >= end_time) {
+    return FALSE;
+  }
+  g_cond_wait_until(cond, mutex, g_get_monotonic_time() + FAKE_POLL);
+  return fake_get_monotonic_time(clock) < end_time;
+}
+
+static const TimerClockType fakeClock = {
+  (gint64 (*)(gpointer)) fake_get_monotonic_time,
+  (gint64 (*)(gpointer)) fake_get_real_time,
+  (gboolean (*)(GCond *, GMutex *, gint64, gpointer)) fake_wait_until
+};
+
+
+/* Time passes: both clocks move on. */
+static void
+fake_advance(FakeClockType *clock, GTimeSpan time) {
+  g_mutex_lock(&clock->mutex);
+  clock->monotonic += time;
+  clock->real      += time;
+  g_mutex_unlock(&clock->mutex);
+}
+
+
+/* The wall clock is set (e.g. by NTP), or goes on while the monotonic clock doesn't (stall, suspend). */
+static void
+fake_step_real(FakeClockType *clock, GTimeSpan time) {
+  g_mutex_lock(&clock->mutex);
+  clock->real += time;
+  g_mutex_unlock(&clock->mutex);
+}
+
+
+static void
+on_warning(TimerEngine *engine, Fixture *fixture) {
+  fixture->warnings++;
+}
+
+
+static void
+on_expired(TimerEngine *engine, Fixture *fixture) {
+  fixture->expiries++;
+}
+
+
+static void
+on_cancelled(TimerEngine *engine, Fixture *fixture) {
+  fixture->cancellations++;
+}
+
+
+static void
+setup(Fixture *fixture, gconstpointer data) {
+  g_mutex_init(&fixture->clock.mutex);
+  fixture->clock.monotonic = G_TIME_SPAN_HOUR; /* anything but TIMER_NOT_ARMED */
+  fixture->clock.real      = FAKE_EPOCH;
+
+  fixture->engine = timer_engine_new();
+  timer_engine_set_clock(fixture->engine, &fakeClock, &fixture->clock);
+  g_signal_connect(fixture->engine, "warning",   G_CALLBACK(on_warning),   fixture);
+  g_signal_connect(fixture->engine, "expired",   G_CALLBACK(on_expired),   fixture);
+  g_signal_connect(fixture->engine, "cancelled", G_CALLBACK(on_cancelled), fixture);
+}
+
+
+static void
+teardown(Fixture *fixture, gconstpointer data) {
+  g_signal_handlers_disconnect_by_data(fixture->engine, fixture);
+  g_object_unref(fixture->engine);
+  g_mutex_clear(&fixture->clock.mutex);
+}
+
+
+/* Run the main loop until *counter reaches count, or for time (real time) at most.  Returns *counter. */
+static guint
+run_until(const guint *counter, guint count, GTimeSpan time) {
+  gint64 end_time = g_get_monotonic_time() + time;
+
+  while ((*counter < count) && (g_get_monotonic_time() < end_time)) {
+    g_main_context_iteration(NULL, FALSE);
+    g_usleep(FAKE_POLL / 4);
+  }
+  return *counter;
+}
+
+
+/* The event counted by counter happens (once more). */
+static void
+assert_happens(const guint *counter) {
+  guint expected = *counter + 1;
+
+  g_assert_cmpuint(run_until(counter, expected, EVENT_TIME), ==, expected);
+}
+
+
+/* The event counted by counter doesn't happen (for a while). */
+static void
+assert_not_happens(const guint *counter) {
+  guint expected = *counter;
+
+  g_assert_cmpuint(run_until(counter, expected + 1, QUIET_TIME), ==, expected);
+}
+
+
+static void
+test_arm_expire(Fixture *fixture, gconstpointer data) {
+  g_assert(timer_engine_command(fixture->engine, TIMER_COMMAND_ARM, 10 * G_TIME_SPAN_SECOND));
+  g_assert(timer_engine_is_armed(fixture->engine));
+  g_assert_cmpint(timer_engine_get_mode(fixture->engine), ==, TIMER_ENGINE_MODE_COUNTDOWN);
+  g_assert_cmpint(timer_engine_get_deadline(fixture->engine), ==, FAKE_EPOCH + 10 * G_TIME_SPAN_SECOND);
+
+  fake_advance(&fixture->clock, 9 * G_TIME_SPAN_SECOND);
+  assert_not_happens(&fixture->expiries);
+  g_assert_cmpint(timer_engine_get_remaining(fixture->engine), ==, G_TIME_SPAN_SECOND);
+
+  fake_advance(&fixture->clock, G_TIME_SPAN_SECOND);
+  assert_happens(&fixture->expiries);
+  g_assert(!timer_engine_is_armed(fixture->engine));
+  g_assert_cmpint(timer_engine_get_deadline(fixture->engine), ==, 0);
+
+  /* nothing to expire, nor to arm in the past */
+  g_assert(!timer_engine_command(fixture->engine, TIMER_COMMAND_EXPIRE, 0));
+  g_assert(!timer_engine_command(fixture->engine, TIMER_COMMAND_ARM_AT, FAKE_EPOCH));
+}
+
+
+/* The warning comes on the whole second at or before warning time ahead of the deadline. */
+static void
+test_warning(Fixture *fixture, gconstpointer data) {
+  timer_engine_set_warning_time(fixture->engine, 2500 * G_TIME_SPAN_MILLISECOND);
+  timer_engine_command(fixture->engine, TIMER_COMMAND_ARM, 10 * G_TIME_SPAN_SECOND);
+
+  fake_advance(&fixture->clock, 6 * G_TIME_SPAN_SECOND);
+  assert_not_happens(&fixture->warnings);
+
+  fake_advance(&fixture->clock, G_TIME_SPAN_SECOND);
+  assert_happens(&fixture->warnings);
+  g_assert_cmpuint(fixture->expiries, ==, 0);
+
+  /* the wall clock stepping back doesn't bring the warning back */
+  fake_step_real(&fixture->clock, -G_TIME_SPAN_HOUR);
+  fake_advance(&fixture->clock, 2 * G_TIME_SPAN_SECOND);
+  assert_not_happens(&fixture->warnings);
+
+  fake_advance(&fixture->clock, G_TIME_SPAN_SECOND);
+  assert_happens(&fixture->expiries);
+  g_assert_cmpuint(fixture->warnings, ==, 1);
+}
+
+
+static void
+test_extend(Fixture *fixture, gconstpointer data) {
+  g_assert(!timer_engine_command(fixture->engine, TIMER_COMMAND_EXTEND, G_TIME_SPAN_SECOND)); /* nothing to extend */
+
+  timer_engine_set_warning_time(fixture->engine, G_TIME_SPAN_SECOND);
+  timer_engine_command(fixture->engine, TIMER_COMMAND_ARM, 10 * G_TIME_SPAN_SECOND);
+  fake_advance(&fixture->clock, 9 * G_TIME_SPAN_SECOND);
+  assert_happens(&fixture->warnings);
+
+  /* a new deadline gets a new warning */
+  g_assert(timer_engine_command(fixture->engine, TIMER_COMMAND_EXTEND, 10 * G_TIME_SPAN_SECOND));
+  g_assert_cmpint(timer_engine_get_deadline(fixture->engine), ==, FAKE_EPOCH + 20 * G_TIME_SPAN_SECOND);
+  g_assert_cmpint(timer_engine_get_remaining(fixture->engine), ==, 11 * G_TIME_SPAN_SECOND);
+
+  fake_advance(&fixture->clock, 9 * G_TIME_SPAN_SECOND);
+  assert_not_happens(&fixture->warnings);
+  fake_advance(&fixture->clock, G_TIME_SPAN_SECOND);
+  assert_happens(&fixture->warnings);
+  assert_not_happens(&fixture->expiries);
+
+  fake_advance(&fixture->clock, G_TIME_SPAN_SECOND);
+  assert_happens(&fixture->expiries);
+}
+
+
+static void
+test_cancel(Fixture *fixture, gconstpointer data) {
+  timer_engine_set_warning_time(fixture->engine, G_TIME_SPAN_SECOND);
+  timer_engine_command(fixture->engine, TIMER_COMMAND_ARM, 10 * G_TIME_SPAN_SECOND);
+  fake_advance(&fixture->clock, 5 * G_TIME_SPAN_SECOND);
+
+  g_assert(timer_engine_command(fixture->engine, TIMER_COMMAND_CANCEL, 0));
+  g_assert_cmpuint(fixture->cancellations, ==, 1);
+  g_assert(!timer_engine_is_armed(fixture->engine));
+  g_assert_cmpint(timer_engine_get_remaining(fixture->engine), ==, 0);
+
+  fake_advance(&fixture->clock, 10 * G_TIME_SPAN_SECOND);
+  assert_not_happens(&fixture->warnings);
+  assert_not_happens(&fixture->expiries);
+
+  /* cancelling again is accepted, but nothing was cancelled */
+  g_assert(timer_engine_command(fixture->engine, TIMER_COMMAND_CANCEL, 0));
+  g_assert_cmpuint(fixture->cancellations, ==, 1);
+}
+
+
+/* A timer armed again after the timer thread detected the expiry, but before the expiry was reported on the
+   main loop, doesn't expire: the new deadline supersedes the pending expiry. */
+static void
+test_arm_pending_expiry(Fixture *fixture, gconstpointer data) {
+  gint64 end_time = g_get_monotonic_time() + EVENT_TIME;
+
+  timer_engine_command(fixture->engine, TIMER_COMMAND_ARM, 10 * G_TIME_SPAN_SECOND);
+  fake_advance(&fixture->clock, 10 * G_TIME_SPAN_SECOND);
+
+  /* wait for the timer thread without running the main loop, so that the expiry stays pending */
+  while (timer_engine_is_armed(fixture->engine) && (g_get_monotonic_time() < end_time)) {
+    g_usleep(FAKE_POLL);
+  }
+  g_assert(!timer_engine_is_armed(fixture->engine));
+
+  g_assert(timer_engine_command(fixture->engine, TIMER_COMMAND_ARM, 10 * G_TIME_SPAN_SECOND));
+  assert_not_happens(&fixture->expiries);
+  g_assert(timer_engine_is_armed(fixture->engine));
+
+  fake_advance(&fixture->clock, 10 * G_TIME_SPAN_SECOND);
+  assert_happens(&fixture->expiries);
+}
+
+
+/* Steps of the wall clock, either way, move neither a countdown nor its reported deadline. */
+static void
+test_wall_clock_steps(Fixture *fixture, gconstpointer data) {
+  timer_engine_command(fixture->engine, TIMER_COMMAND_ARM, 10 * G_TIME_SPAN_SECOND);
+
+  fake_step_real(&fixture->clock, G_TIME_SPAN_HOUR);
+  assert_not_happens(&fixture->expiries);
+  fake_step_real(&fixture->clock, -2 * G_TIME_SPAN_HOUR);
+  assert_not_happens(&fixture->expiries);
+  g_assert_cmpint(timer_engine_get_remaining(fixture->engine), ==, 10 * G_TIME_SPAN_SECOND);
+  g_assert_cmpint(timer_engine_get_deadline(fixture->engine), ==, FAKE_EPOCH + 10 * G_TIME_SPAN_SECOND);
+
+  fake_advance(&fixture->clock, 10 * G_TIME_SPAN_SECOND);
+  assert_happens(&fixture->expiries);
+}
+
+
+/* A wall-clock deadline is converted to monotonic time when armed; DST doesn't change the wall-clock time
+   (UTC) at all, and a step of the fake wall clock alone (no notice from the kernel) doesn't move it. */
+static void
+test_clock_mode(Fixture *fixture, gconstpointer data) {
+  g_assert(timer_engine_command(fixture->engine, TIMER_COMMAND_ARM_AT, FAKE_EPOCH + 10 * G_TIME_SPAN_SECOND));
+  g_assert_cmpint(timer_engine_get_mode(fixture->engine), ==, TIMER_ENGINE_MODE_CLOCK);
+  g_assert_cmpint(timer_engine_get_remaining(fixture->engine), ==, 10 * G_TIME_SPAN_SECOND);
+
+  fake_step_real(&fixture->clock, -G_TIME_SPAN_MINUTE);
+  fake_advance(&fixture->clock, 9 * G_TIME_SPAN_SECOND);
+  assert_not_happens(&fixture->expiries);
+
+  fake_advance(&fixture->clock, G_TIME_SPAN_SECOND);
+  assert_happens(&fixture->expiries);
+}
+
+
+/* While the monotonic clock stalls, the timer waits however much the wall clock goes on. */
+static void
+test_monotonic_stall(Fixture *fixture, gconstpointer data) {
+  guint i;
+
+  timer_engine_set_warning_time(fixture->engine, G_TIME_SPAN_SECOND);
+  timer_engine_command(fixture->engine, TIMER_COMMAND_ARM, 10 * G_TIME_SPAN_SECOND);
+
+  for (i=0; i<5; i++) {
+    fake_step_real(&fixture->clock, 5 * G_TIME_SPAN_SECOND);
+  }
+  assert_not_happens(&fixture->warnings);
+  assert_not_happens(&fixture->expiries);
+  g_assert_cmpint(timer_engine_get_remaining(fixture->engine), ==, 10 * G_TIME_SPAN_SECOND);
+
+  fake_advance(&fixture->clock, 10 * G_TIME_SPAN_SECOND);
+  assert_happens(&fixture->expiries);
+}
+
+
+/* A suspend gap (the monotonic clock doesn't count suspend) delays the expiry by the time suspended. */
+static void
+test_suspend_gap(Fixture *fixture, gconstpointer data) {
+  timer_engine_command(fixture->engine, TIMER_COMMAND_ARM, 10 * G_TIME_SPAN_SECOND);
+  fake_advance(&fixture->clock, 5 * G_TIME_SPAN_SECOND);
+
+  fake_step_real(&fixture->clock, 8 * G_TIME_SPAN_HOUR); /* suspended for the night */
+  assert_not_happens(&fixture->expiries);
+  g_assert_cmpint(timer_engine_get_remaining(fixture->engine), ==, 5 * G_TIME_SPAN_SECOND);
+
+  fake_advance(&fixture->clock, 5 * G_TIME_SPAN_SECOND);
+  assert_happens(&fixture->expiries);
+}
+
+
+int
+main(int argc, char *argv[]) {
+  g_test_init(&argc, &argv, NULL);
+
+  g_test_add("/engine/arm-expire",         Fixture, NULL, setup, test_arm_expire,         teardown);
+  g_test_add("/engine/warning",            Fixture, NULL, setup, test_warning,            teardown);
+  g_test_add("/engine/extend",             Fixture, NULL, setup, test_extend,             teardown);
+  g_test_add("/engine/cancel",             Fixture, NULL, setup, test_cancel,             teardown);
+  g_test_add("/engine/arm-pending-expiry", Fixture, NULL, setup, test_arm_pending_expiry, teardown);
+  g_test_add("/engine/wall-clock-steps",   Fixture, NULL, setup, test_wall_clock_steps,   teardown);
+  g_test_add("/engine/clock-mode",         Fixture, NULL, setup, test_clock_mode,         teardown);
+  g_test_add("/engine/monotonic-stall",    Fixture, NULL, setup, test_monotonic_stall,    teardown);
+  g_test_add("/engine/suspend-gap",        Fixture, NULL, setup, test_suspend_gap,        teardown);
+
+  return g_test_run();
+}
@@ -0,0 +1,158 @@
+/*
+ * test-netclock.c
+ * Loopback test of TimerNetClock: a provider and two clients on 127.0.0.1,
+ * each with an engine of its own, the way the instances of a video wall
+ * share a clock.  Once the clients are synced, the three engines are armed
+ * with TIMER_COMMAND_ARM_AT for the same deadline of the shared clock, and
+ * their expiries, measured in shared time, must be at most MAX_SKEW apart.
+ * All of them run on the same machine, so this checks the plumbing (the
+ * deadline referred to the shared clock, waited for and reported) rather
+ * than the accuracy of the synchronization over a real network.
+ *
+ *   Copyright (C) 2013 Christopher A. Doyle
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License along
+ *   with this program; if not, write to the Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "config.h"
+
+#include <string.h>
+#include <gst/gst.h>
+
+#include "timer-engine.h"
+#include "timer-netclock.h"
+#include "timer-settings.h"
+
+#define TEST_PORT    (TIMER_NETCLOCK_PORT + 10000) /* away from a provider running on the default port */
+#define SYNC_TIME    (3 * G_TIME_SPAN_SECOND)       /* real time the clients are given to sync (checked every second) */
+#define LEAD_TIME    (G_TIME_SPAN_SECOND)           /* from arming to the deadline */
+#define EVENT_TIME   (5 * G_TIME_SPAN_SECOND)       /* real time the expiries are waited for at most */
+#define MAX_SKEW     (20 * G_TIME_SPAN_MILLISECOND) /* largest difference between two expiries */
+#define PARTICIPANTS (3)                            /* the provider and two clients */
+
+/* A totem instance taking part in the shared clock. */
+typedef struct {
+  TimerEngine   *engine;
+  TimerNetClock *netclock;
+  gint64         deadline; /* in shared time */
+  gint64         lateness; /* shared time of the expiry minus deadline, measured in "expired" */
+  guint          expiries;
+} ParticipantType;
+
+
+static void
+on_expired(TimerEngine *engine, ParticipantType *participant) {
+  participant->lateness = timer_engine_get_time(engine) - participant->deadline;
+  participant->expiries++;
+}
+
+
+static void
+participant_init(ParticipantType *participant, const gchar *role) {
+  gchar         *data     = g_strdup_printf("[NetClock]\nRole=%s\nAddress=127.0.0.1\nPort=%d\n", role, TEST_PORT);
+  TimerSettings *settings = timer_settings_parse(data, strlen(data));
+
+  participant->engine   = timer_engine_new();
+  participant->netclock = timer_netclock_new(settings, participant->engine);
+  participant->expiries = 0;
+  g_signal_connect(participant->engine, "expired", G_CALLBACK(on_expired), participant);
+
+  timer_settings_free(settings);
+  g_free(data);
+}
+
+
+static void
+participant_clear(ParticipantType *participant) {
+  timer_netclock_free(participant->netclock);
+  g_signal_handlers_disconnect_by_data(participant->engine, participant);
+  g_object_unref(participant->engine);
+}
+
+
+static gboolean
+all_expired(const ParticipantType *participants) {
+  guint i;
+
+  for (i=0; i<PARTICIPANTS; i++) {
+    if (!participants[i].expiries) {
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+
+/* Run the main loop for time (real time), or until every participant expired if participants is given. */
+static void
+run_for(GTimeSpan time, const ParticipantType *participants) {
+  gint64 end_time = g_get_monotonic_time() + time;
+
+  while ((g_get_monotonic_time() < end_time) && !(participants && all_expired(participants))) {
+    g_main_context_iteration(NULL, FALSE);
+    g_usleep(G_TIME_SPAN_MILLISECOND);
+  }
+}
+
+
+static void
+test_synchronized_expiry(void) {
+  ParticipantType participants[PARTICIPANTS];
+  gint64          deadline;
+  gint64          earliest;
+  gint64          latest;
+  guint           i;
+
+  participant_init(&participants[0], "provider");
+  for (i=1; i<PARTICIPANTS; i++) {
+    participant_init(&participants[i], "client");
+  }
+  run_for(SYNC_TIME, NULL);
+
+  /* the deadline is given in the provider's time, as over D-Bus */
+  deadline = timer_engine_get_time(participants[0].engine) + LEAD_TIME;
+  for (i=0; i<PARTICIPANTS; i++) {
+    participants[i].deadline = deadline;
+    g_assert(timer_engine_command(participants[i].engine, TIMER_COMMAND_ARM_AT, deadline));
+    g_assert_cmpint(timer_engine_get_mode(participants[i].engine), ==, TIMER_ENGINE_MODE_CLOCK);
+  }
+  run_for(EVENT_TIME, participants);
+
+  earliest = G_MAXINT64;
+  latest   = G_MININT64;
+  for (i=0; i<PARTICIPANTS; i++) {
+    g_assert_cmpuint(participants[i].expiries, ==, 1);
+    g_assert_cmpint(participants[i].lateness, >, -MAX_SKEW);
+    earliest = MIN(earliest, participants[i].lateness);
+    latest   = MAX(latest, participants[i].lateness);
+  }
+  g_test_message("expiry skew: %" G_GINT64_FORMAT " us", latest - earliest);
+  g_assert_cmpint(latest - earliest, <=, MAX_SKEW);
+
+  for (i=0; i<PARTICIPANTS; i++) {
+    participant_clear(&participants[i]);
+  }
+}
+
+
+int
+main(int argc, char *argv[]) {
+  g_test_init(&argc, &argv, NULL);
+  gst_init(&argc, &argv);
+
+  g_test_add_func("/netclock/synchronized-expiry", test_synchronized_expiry);
+
+  return g_test_run();
+}
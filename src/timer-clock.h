@@ -0,0 +1,46 @@
+/*
+ * timer-clock.h
+ * The clock a TimerEngine reads and waits on, replaceable to simulate
+ * clock jumps, monotonic stalls and suspend gaps, or to refer deadlines to a
+ * shared clock (see timer_engine_set_clock()).
+ * An injected clock
+ *   - returns its notion of the monotonic and wall-clock times,
+ *   - implements wait_until() like g_cond_wait_until(): called with mutex
+ *     held, returns FALSE once its monotonic time reached end_time and TRUE
+ *     when cond was signalled (or spuriously), with mutex held again.
+ * The tick source of the engine computes its next tick from the injected
+ * clock too, but waits for it on the main loop, i.e. in system time.
+ *
+ *   Copyright (C) 2013 Christopher A. Doyle
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License along
+ *   with this program; if not, write to the Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef TIMER_CLOCK_H
+#define TIMER_CLOCK_H
+
+#include <glib.h>
+
+#include "timer-engine.h"
+
+typedef struct {
+  gint64   (*get_monotonic_time)(gpointer user_data);
+  gint64   (*get_real_time)     (gpointer user_data);
+  gboolean (*wait_until)        (GCond *cond, GMutex *mutex, gint64 end_time, gpointer user_data);
+} TimerClockType;
+
+void timer_engine_set_clock(TimerEngine *engine, const TimerClockType *clock, gpointer user_data);
+
+#endif /* TIMER_CLOCK_H */
@@ -0,0 +1,146 @@
+/*
+ * timer-config.c
+ * The settings of the plugin, reloaded when the settings file changes.
+ * The settings file is watched (GFileMonitor, i.e. inotify); on a change it
+ * is read asynchronously and parsed into a new TimerSettings, which
+ * replaces the current one.  Everything runs on the main thread: the
+ * settings are only read there (through timer_config_get(), or handed to
+ * the modules when they change), and the engine threads only get copies of
+ * the values they need (e.g. the slack), so no locking is needed.
+ *
+ *   Copyright (C) 2013 Christopher A. Doyle
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License along
+ *   with this program; if not, write to the Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "config.h"
+
+#include "timer-config.h"
+
+struct _TimerConfig {
+  TimerSettings          *current;     /* settings in use */
+  GFile                  *file;        /* the settings file */
+  GFileMonitor           *monitor;     /* watching it, NULL if it can't be watched */
+  GCancellable           *cancellable; /* for the pending read */
+  TimerConfigChangedFunc  changed;
+  gpointer                user_data;
+};
+
+
+/* Replace the current settings.  Runs from the main loop, so nobody holds the old ones any more. */
+static void
+publish(TimerConfig *config, TimerSettings *settings) {
+  TimerSettings *old = config->current;
+
+  config->current = settings;
+  if (config->changed) {
+    config->changed(settings, config->user_data);
+  }
+  timer_settings_free(old);
+}
+
+
+static void
+on_loaded(GObject *source, GAsyncResult *result, gpointer user_data) {
+  TimerConfig *config;
+  gchar       *contents = NULL;
+  gsize        length   = 0;
+  GError      *error    = NULL;
+  gint64       start;
+
+  if (!g_file_load_contents_finish(G_FILE(source), result, &contents, &length, NULL, &error)) {
+    if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+      g_error_free(error);
+      return; /* config is gone, or a newer read replaced this one */
+    }
+    g_error_free(error); /* e.g. the file was removed: back to the defaults */
+  }
+  config = user_data;
+
+  start = g_get_monotonic_time();
+  publish(config, timer_settings_parse(contents, length));
+  g_debug("Timer: settings reloaded in %" G_GINT64_FORMAT " us", g_get_monotonic_time() - start);
+  g_free(contents);
+}
+
+
+static void
+on_file_changed(GFileMonitor      *monitor,
+                GFile             *file,
+                GFile             *other_file,
+                GFileMonitorEvent  event_type,
+                TimerConfig       *config) {
+  if ((event_type != G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT) &&
+      (event_type != G_FILE_MONITOR_EVENT_CREATED) &&
+      (event_type != G_FILE_MONITOR_EVENT_DELETED)) {
+    return;
+  }
+
+  /* only the latest read is applied */
+  g_cancellable_cancel(config->cancellable);
+  g_object_unref(config->cancellable);
+  config->cancellable = g_cancellable_new();
+  g_file_load_contents_async(config->file, config->cancellable, on_loaded, config);
+}
+
+
+/* Load the settings and keep them up to date.  changed (may be NULL) is called after each reload. */
+TimerConfig *
+timer_config_new(TimerConfigChangedFunc changed, gpointer user_data) {
+  TimerConfig *config = g_new0(TimerConfig, 1);
+  gchar       *path   = timer_settings_get_path();
+  GError      *error  = NULL;
+
+  config->current     = timer_settings_load();
+  config->file        = g_file_new_for_path(path);
+  config->cancellable = g_cancellable_new();
+  config->changed     = changed;
+  config->user_data   = user_data;
+
+  config->monitor = g_file_monitor_file(config->file, G_FILE_MONITOR_NONE, NULL, &error);
+  if (config->monitor) {
+    g_signal_connect(config->monitor, "changed", G_CALLBACK(on_file_changed), config);
+  } else {
+    g_warning("Timer: could not watch %s, changes need a restart: %s", path, error->message);
+    g_error_free(error);
+  }
+  g_free(path);
+
+  return config;
+}
+
+
+/* Free config, and its settings. */
+void
+timer_config_free(TimerConfig *config) {
+  if (config->monitor) {
+    g_signal_handlers_disconnect_by_func(config->monitor, on_file_changed, config);
+    g_file_monitor_cancel(config->monitor);
+    g_object_unref(config->monitor);
+  }
+  g_cancellable_cancel(config->cancellable);
+  g_object_unref(config->cancellable);
+  g_object_unref(config->file);
+
+  timer_settings_free(config->current);
+  g_free(config);
+}
+
+
+/* The current settings.  Valid until the main loop runs again. */
+const TimerSettings *
+timer_config_get(TimerConfig *config) {
+  return config->current;
+}
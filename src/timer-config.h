@@ -0,0 +1,38 @@
+/*
+ * timer-config.h
+ * The settings of the plugin, reloaded when the settings file changes.
+ *
+ *   Copyright (C) 2013 Christopher A. Doyle
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License along
+ *   with this program; if not, write to the Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef TIMER_CONFIG_H
+#define TIMER_CONFIG_H
+
+#include <gio/gio.h>
+
+#include "timer-settings.h"
+
+typedef struct _TimerConfig TimerConfig;
+
+/* Called on the main thread after a reload published new settings. */
+typedef void (*TimerConfigChangedFunc)(const TimerSettings *settings, gpointer user_data);
+
+TimerConfig         *timer_config_new (TimerConfigChangedFunc changed, gpointer user_data);
+void                 timer_config_free(TimerConfig *config);
+const TimerSettings *timer_config_get (TimerConfig *config);
+
+#endif /* TIMER_CONFIG_H */
@@ -0,0 +1,331 @@
+/*
+ * timer-dbus.c
+ * D-Bus control interface for the timer.
+ * The object is exported on the session bus as TIMER_DBUS_PATH under the
+ * well-known name TIMER_DBUS_NAME and provides:
+ *   - Arm(u minutes)         start/restart the timer
+ *   - ArmAt(x deadline)      start/restart the timer to expire at a wall-clock
+ *                            time (microseconds since the epoch), of the shared
+ *                            clock if any (see timer-netclock.c)
+ *   - GetTime() -> x         the wall-clock time deadlines refer to
+ *   - Cancel()               cancel the timer
+ *   - Extend(u minutes)      add time to the running timer
+ *   - GetRemaining() -> x    seconds until the timer expires (0 if not running)
+ *   - GetMetrics() -> a{sv}  counters and timings of the plugin (see timer-metrics.c)
+ *   - Armed (b), Deadline (x) properties, the deadline being the wall-clock
+ *     time of expiry in microseconds since the epoch (0 if not running).
+ * Changes to the properties (notify::armed and notify::deadline of the
+ * engine) are coalesced into a single PropertiesChanged signal emitted from
+ * an idle callback.
+ * All methods are routed through timer_engine_command(), the same path used
+ * by the menu items.
+ * Further plugin instances of the same process (instance n > 0) export their
+ * object as TIMER_DBUS_PATH/n on the same connection, reached through the
+ * name owned by the first instance.
+ *
+ *   Copyright (C) 2013 Christopher A. Doyle
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License along
+ *   with this program; if not, write to the Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "config.h"
+
+#include "timer-engine.h"
+#include "timer-dbus.h"
+#include "timer-metrics.h"
+
+#define TIMER_DBUS_ERROR_INVALID_TIMEOUT TIMER_DBUS_INTERFACE ".Error.InvalidTimeout"
+#define TIMER_DBUS_ERROR_NOT_ARMED       TIMER_DBUS_INTERFACE ".Error.NotArmed"
+
+struct _TimerDBus {
+  TimerEngine     *engine;          /* controlled by this object */
+  gchar           *path;            /* object path, TIMER_DBUS_PATH for the first instance */
+  guint            owner_id;        /* from g_bus_own_name(), 0 unless the first instance */
+  GCancellable    *cancellable;     /* for g_bus_get(), NULL for the first instance */
+  GDBusConnection *connection;      /* NULL until the bus has been acquired */
+  guint            registration_id; /* 0 until the object has been registered */
+  guint            changed_id;      /* idle source emitting PropertiesChanged, 0 if none pending */
+  gboolean         armed;           /* value of Armed last announced */
+  gint64           deadline;        /* value of Deadline last announced */
+};
+
+static const gchar introspection_xml[] =
+  "<node>"
+  "  <interface name='" TIMER_DBUS_INTERFACE "'>"
+  "    <method name='Arm'>"
+  "      <arg type='u' name='minutes' direction='in'/>"
+  "    </method>"
+  "    <method name='ArmAt'>"
+  "      <arg type='x' name='deadline' direction='in'/>"
+  "    </method>"
+  "    <method name='Cancel'/>"
+  "    <method name='Extend'>"
+  "      <arg type='u' name='minutes' direction='in'/>"
+  "    </method>"
+  "    <method name='GetRemaining'>"
+  "      <arg type='x' name='seconds' direction='out'/>"
+  "    </method>"
+  "    <method name='GetTime'>"
+  "      <arg type='x' name='time' direction='out'/>"
+  "    </method>"
+  "    <method name='GetMetrics'>"
+  "      <arg type='a{sv}' name='metrics' direction='out'/>"
+  "    </method>"
+  "    <property type='b' name='Armed' access='read'/>"
+  "    <property type='x' name='Deadline' access='read'/>"
+  "  </interface>"
+  "</node>";
+
+static GDBusNodeInfo *introspection_data = NULL;
+
+
+static void
+return_invalid_timeout(GDBusMethodInvocation *invocation) {
+  gchar *message = g_strdup_printf("Timeout must be within %d..%d minutes", TIMER_MIN, TIMER_MAX);
+
+  g_dbus_method_invocation_return_dbus_error(invocation, TIMER_DBUS_ERROR_INVALID_TIMEOUT, message);
+  g_free(message);
+}
+
+
+static void
+handle_method_call(GDBusConnection       *connection,
+                   const gchar           *sender,
+                   const gchar           *object_path,
+                   const gchar           *interface_name,
+                   const gchar           *method_name,
+                   GVariant              *parameters,
+                   GDBusMethodInvocation *invocation,
+                   gpointer               user_data) {
+  TimerDBus *dbus     = user_data;
+  guint32    minutes  = 0;
+  gint64     deadline = 0;
+
+  if (g_strcmp0(method_name, "Arm") == 0) {
+    g_variant_get(parameters, "(u)", &minutes);
+    if ((minutes < TIMER_MIN) || (minutes > TIMER_MAX)) {
+      return_invalid_timeout(invocation);
+      return;
+    }
+    timer_engine_command(dbus->engine, TIMER_COMMAND_ARM, minutes * G_TIME_SPAN_MINUTE);
+    g_dbus_method_invocation_return_value(invocation, NULL);
+
+  } else if (g_strcmp0(method_name, "ArmAt") == 0) {
+    g_variant_get(parameters, "(x)", &deadline);
+    if ((deadline <= timer_engine_get_time(dbus->engine)) ||
+        (deadline > timer_engine_get_time(dbus->engine) + TIMER_MAX * G_TIME_SPAN_MINUTE)) {
+      return_invalid_timeout(invocation);
+      return;
+    }
+    timer_engine_command(dbus->engine, TIMER_COMMAND_ARM_AT, deadline);
+    g_dbus_method_invocation_return_value(invocation, NULL);
+
+  } else if (g_strcmp0(method_name, "Cancel") == 0) {
+    timer_engine_command(dbus->engine, TIMER_COMMAND_CANCEL, 0);
+    g_dbus_method_invocation_return_value(invocation, NULL);
+
+  } else if (g_strcmp0(method_name, "Extend") == 0) {
+    g_variant_get(parameters, "(u)", &minutes);
+    if ((minutes < TIMER_MIN) || (minutes > TIMER_MAX)) {
+      return_invalid_timeout(invocation);
+      return;
+    }
+    if (!timer_engine_command(dbus->engine, TIMER_COMMAND_EXTEND, minutes * G_TIME_SPAN_MINUTE)) {
+      g_dbus_method_invocation_return_dbus_error(invocation, TIMER_DBUS_ERROR_NOT_ARMED,
+                                                 "The timer is not running");
+      return;
+    }
+    g_dbus_method_invocation_return_value(invocation, NULL);
+
+  } else if (g_strcmp0(method_name, "GetRemaining") == 0) {
+    g_dbus_method_invocation_return_value(invocation,
+                                          g_variant_new("(x)", timer_engine_get_remaining(dbus->engine) / G_TIME_SPAN_SECOND));
+
+  } else if (g_strcmp0(method_name, "GetTime") == 0) {
+    g_dbus_method_invocation_return_value(invocation, g_variant_new("(x)", timer_engine_get_time(dbus->engine)));
+
+  } else if (g_strcmp0(method_name, "GetMetrics") == 0) {
+    g_dbus_method_invocation_return_value(invocation,
+                                          g_variant_new("(@a{sv})", timer_metrics_to_variant()));
+  }
+}
+
+
+static GVariant *
+handle_get_property(GDBusConnection  *connection,
+                    const gchar      *sender,
+                    const gchar      *object_path,
+                    const gchar      *interface_name,
+                    const gchar      *property_name,
+                    GError          **error,
+                    gpointer          user_data) {
+  TimerDBus *dbus = user_data;
+
+  if (g_strcmp0(property_name, "Armed") == 0) {
+    return g_variant_new_boolean(timer_engine_is_armed(dbus->engine));
+  } else if (g_strcmp0(property_name, "Deadline") == 0) {
+    return g_variant_new_int64(timer_engine_get_deadline(dbus->engine));
+  }
+  return NULL;
+}
+
+
+static const GDBusInterfaceVTable interface_vtable = {
+  handle_method_call,
+  handle_get_property,
+  NULL
+};
+
+
+/* Emit a single PropertiesChanged signal holding every property that changed since the last one. */
+static gboolean
+emit_properties_changed(TimerDBus *dbus) {
+  GVariantBuilder builder;
+  gboolean        armed    = timer_engine_is_armed(dbus->engine);
+  gint64          deadline = timer_engine_get_deadline(dbus->engine);
+  gboolean        changed  = FALSE;
+
+  dbus->changed_id = 0;
+
+  g_variant_builder_init(&builder, G_VARIANT_TYPE_VARDICT);
+  if (armed != dbus->armed) {
+    g_variant_builder_add(&builder, "{sv}", "Armed", g_variant_new_boolean(armed));
+    dbus->armed = armed;
+    changed     = TRUE;
+  }
+  if (deadline != dbus->deadline) {
+    g_variant_builder_add(&builder, "{sv}", "Deadline", g_variant_new_int64(deadline));
+    dbus->deadline = deadline;
+    changed        = TRUE;
+  }
+
+  if (changed && dbus->registration_id) {
+    g_dbus_connection_emit_signal(dbus->connection,
+                                  NULL,
+                                  dbus->path,
+                                  "org.freedesktop.DBus.Properties",
+                                  "PropertiesChanged",
+                                  g_variant_new("(sa{sv}as)", TIMER_DBUS_INTERFACE, &builder, NULL),
+                                  NULL);
+  } else {
+    g_variant_builder_clear(&builder);
+  }
+
+  return G_SOURCE_REMOVE;
+}
+
+
+/* Called whenever the state of the timer changed; schedules a (coalesced) PropertiesChanged signal. */
+static void
+on_engine_changed(TimerDBus *dbus) {
+  if (!dbus->changed_id) {
+    dbus->changed_id = g_idle_add((GSourceFunc) emit_properties_changed, dbus);
+  }
+}
+
+
+static void
+on_bus_acquired(GDBusConnection *connection, const gchar *name, gpointer user_data) {
+  TimerDBus *dbus  = user_data;
+  GError    *error = NULL;
+
+  dbus->connection      = g_object_ref(connection);
+  dbus->registration_id = g_dbus_connection_register_object(connection,
+                                                            dbus->path,
+                                                            introspection_data->interfaces[0],
+                                                            &interface_vtable,
+                                                            dbus,
+                                                            NULL,
+                                                            &error);
+  if (!dbus->registration_id) {
+    g_warning("Timer: could not export D-Bus object: %s", error->message);
+    g_error_free(error);
+  }
+}
+
+
+/* Further instances: the connection is shared with the first one, which owns the name. */
+static void
+on_bus_get(GObject *source, GAsyncResult *result, gpointer user_data) {
+  GDBusConnection *connection;
+  GError          *error = NULL;
+
+  connection = g_bus_get_finish(result, &error);
+  if (!connection) {
+    if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+      g_warning("Timer: could not connect to the session bus: %s", error->message);
+    }
+    g_error_free(error);
+    return;
+  }
+  on_bus_acquired(connection, NULL, user_data);
+  g_object_unref(connection);
+}
+
+
+/* Export an object controlling engine on the session bus, for plugin instance instance (0 for the first one). */
+TimerDBus *
+timer_dbus_export(TimerEngine *engine, guint instance) {
+  TimerDBus *dbus = g_new0(TimerDBus, 1);
+
+  dbus->engine = engine;
+  dbus->path   = instance ? g_strdup_printf(TIMER_DBUS_PATH "/%u", instance) : g_strdup(TIMER_DBUS_PATH);
+
+  if (!introspection_data) {
+    introspection_data = g_dbus_node_info_new_for_xml(introspection_xml, NULL);
+  }
+
+  dbus->armed    = timer_engine_is_armed(dbus->engine);
+  dbus->deadline = timer_engine_get_deadline(dbus->engine);
+  g_signal_connect_swapped(engine, "notify::armed",    G_CALLBACK(on_engine_changed), dbus);
+  g_signal_connect_swapped(engine, "notify::deadline", G_CALLBACK(on_engine_changed), dbus);
+
+  if (instance) {
+    dbus->cancellable = g_cancellable_new();
+    g_bus_get(G_BUS_TYPE_SESSION, dbus->cancellable, on_bus_get, dbus);
+    return dbus;
+  }
+  dbus->owner_id = g_bus_own_name(G_BUS_TYPE_SESSION,
+                                  TIMER_DBUS_NAME,
+                                  G_BUS_NAME_OWNER_FLAGS_NONE,
+                                  on_bus_acquired,
+                                  NULL,
+                                  NULL,
+                                  dbus,
+                                  NULL);
+  return dbus;
+}
+
+
+void
+timer_dbus_unexport(TimerDBus *dbus) {
+  g_signal_handlers_disconnect_by_func(dbus->engine, on_engine_changed, dbus);
+  if (dbus->changed_id) {
+    g_source_remove(dbus->changed_id);
+  }
+  if (dbus->registration_id) {
+    g_dbus_connection_unregister_object(dbus->connection, dbus->registration_id);
+  }
+  if (dbus->owner_id) {
+    g_bus_unown_name(dbus->owner_id);
+  }
+  if (dbus->cancellable) {
+    g_cancellable_cancel(dbus->cancellable); /* the callback of a pending g_bus_get() doesn't touch dbus */
+    g_object_unref(dbus->cancellable);
+  }
+  g_clear_object(&dbus->connection);
+  g_free(dbus->path);
+  g_free(dbus);
+}
@@ -0,0 +1,38 @@
+/*
+ * timer-dbus.h
+ * D-Bus control interface for the timer.
+ *
+ *   Copyright (C) 2013 Christopher A. Doyle
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License along
+ *   with this program; if not, write to the Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef TIMER_DBUS_H
+#define TIMER_DBUS_H
+
+#include <gio/gio.h>
+
+#include "timer-engine.h"
+
+#define TIMER_DBUS_NAME      "org.gnome.Totem.Plugins.Timer"
+#define TIMER_DBUS_PATH      "/org/gnome/Totem/Plugins/Timer"
+#define TIMER_DBUS_INTERFACE "org.gnome.Totem.Plugins.Timer"
+
+typedef struct _TimerDBus TimerDBus;
+
+TimerDBus *timer_dbus_export  (TimerEngine *engine, guint instance);
+void       timer_dbus_unexport(TimerDBus *dbus);
+
+#endif /* TIMER_DBUS_H */
@@ -0,0 +1,151 @@
+/*
+ * timer-dwell.c
+ * Longest time each item of the playlist plays ([Dwell] group of the
+ * settings), e.g. for signage: when an item is opened, the first rule whose
+ * glob matches its MRL gives its dwell time, and once that time has passed
+ * totem moves on to the next item (at the end of the playlist, only when
+ * totem repeats it).  An item no rule matches plays without limit.
+ * The dwell time is kept by a TimerEngine of its own, armed on every item
+ * change and cancelled when the item is closed, so nothing runs between
+ * changes.  It counts from the opening of the item, pauses included.
+ * Advances are counted in the dwell-advances metric.
+ *
+ *   Copyright (C) 2013 Christopher A. Doyle
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License along
+ *   with this program; if not, write to the Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "config.h"
+
+#include "timer-dwell.h"
+#include "timer-engine.h"
+#include "timer-metrics.h"
+
+struct _TimerDwell {
+  TotemObject *totem;
+  TimerEngine *engine; /* keeping the dwell time of the current item */
+  GArray      *rules;  /* copy of the [Dwell] rules, of TimerDwellRuleType */
+};
+
+
+/* Returns the dwell time of mrl, 0 for no limit. */
+static GTimeSpan
+lookup_dwell(TimerDwell *dwell, const gchar *mrl) {
+  TimerDwellRuleType *rule;
+  guint               i;
+
+  for (i=0; i<dwell->rules->len; i++) {
+    rule = &g_array_index(dwell->rules, TimerDwellRuleType, i);
+    if (g_pattern_match_simple(rule->pattern, mrl)) {
+      return rule->dwell;
+    }
+  }
+  return 0;
+}
+
+
+static void
+on_engine_expired(TimerEngine *engine, TimerDwell *dwell) {
+  timer_metrics_add("dwell-advances", 1);
+  g_debug("Timer: dwell time over, moving on to the next item");
+  totem_action_next(dwell->totem);
+}
+
+
+static void
+on_file_opened(TotemObject *totem, const gchar *mrl, TimerDwell *dwell) {
+  GTimeSpan time = mrl ? lookup_dwell(dwell, mrl) : 0;
+
+  if (time > 0) {
+    timer_engine_command(dwell->engine, TIMER_COMMAND_ARM, time); /* restarts a running dwell */
+  } else {
+    timer_engine_command(dwell->engine, TIMER_COMMAND_CANCEL, 0);
+  }
+}
+
+
+static void
+on_file_closed(TotemObject *totem, TimerDwell *dwell) {
+  timer_engine_command(dwell->engine, TIMER_COMMAND_CANCEL, 0);
+}
+
+
+static void
+copy_rules(TimerDwell *dwell, const TimerSettings *settings) {
+  TimerDwellRuleType *rule;
+  TimerDwellRuleType  copy;
+  guint               i;
+
+  g_array_set_size(dwell->rules, 0);
+  for (i=0; i<settings->dwell_rules->len; i++) {
+    rule         = &g_array_index(settings->dwell_rules, TimerDwellRuleType, i);
+    copy.pattern = g_strdup(rule->pattern);
+    copy.dwell   = rule->dwell;
+    g_array_append_val(dwell->rules, copy);
+  }
+}
+
+
+static void
+clear_rule(TimerDwellRuleType *rule) {
+  g_free(rule->pattern);
+}
+
+
+/* Limit the time the items of totem play, as configured by settings. */
+TimerDwell *
+timer_dwell_new(const TimerSettings *settings, TotemObject *totem) {
+  TimerDwell *dwell = g_new0(TimerDwell, 1);
+  gchar      *mrl;
+
+  dwell->totem  = totem;
+  dwell->engine = timer_engine_new();
+  dwell->rules  = g_array_new(FALSE, FALSE, sizeof(TimerDwellRuleType));
+  g_array_set_clear_func(dwell->rules, (GDestroyNotify) clear_rule);
+  copy_rules(dwell, settings);
+
+  timer_engine_set_slack(dwell->engine, settings->slack);
+
+  g_signal_connect(dwell->engine, "expired",     G_CALLBACK(on_engine_expired), dwell);
+  g_signal_connect(totem,         "file-opened", G_CALLBACK(on_file_opened),    dwell);
+  g_signal_connect(totem,         "file-closed", G_CALLBACK(on_file_closed),    dwell);
+
+  /* the item already open (if any) gets its full dwell time from now */
+  mrl = totem_get_current_mrl(totem);
+  if (mrl) {
+    on_file_opened(totem, mrl, dwell);
+    g_free(mrl);
+  }
+
+  return dwell;
+}
+
+
+void
+timer_dwell_free(TimerDwell *dwell) {
+  g_signal_handlers_disconnect_by_data(dwell->totem, dwell);
+  g_signal_handlers_disconnect_by_data(dwell->engine, dwell);
+  g_object_unref(dwell->engine);
+  g_array_free(dwell->rules, TRUE);
+  g_free(dwell);
+}
+
+
+/* Apply changed settings.  The new rules apply from the next item on. */
+void
+timer_dwell_configure(TimerDwell *dwell, const TimerSettings *settings) {
+  timer_engine_set_slack(dwell->engine, settings->slack);
+  copy_rules(dwell, settings);
+}
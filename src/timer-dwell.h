@@ -0,0 +1,35 @@
+/*
+ * timer-dwell.h
+ * Longest time each item of the playlist plays before totem moves on.
+ *
+ *   Copyright (C) 2013 Christopher A. Doyle
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License along
+ *   with this program; if not, write to the Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef TIMER_DWELL_H
+#define TIMER_DWELL_H
+
+#include <totem.h>
+
+#include "timer-settings.h"
+
+typedef struct _TimerDwell TimerDwell;
+
+TimerDwell *timer_dwell_new      (const TimerSettings *settings, TotemObject *totem);
+void        timer_dwell_free     (TimerDwell *dwell);
+void        timer_dwell_configure(TimerDwell *dwell, const TimerSettings *settings);
+
+#endif /* TIMER_DWELL_H */
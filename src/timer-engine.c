@@ -0,0 +1,1170 @@
+/*
+ * timer-engine.c
+ * The timer engine: a GObject owning a thread that waits for the timer to
+ * expire.
+ * Commands are applied on the GUI thread (the thread owning the main context
+ * the engine was created in) and the resulting signals are emitted there
+ * directly; the warning and the expiry are detected by the timer_function
+ * thread and reported to that main context.
+ * The per-second tick is not driven by the timer thread: it is a source in
+ * the main context that only exists while the timer runs and someone
+ * subscribed to the tick signal (timer_engine_ref_tick()), so without
+ * subscribers the timer thread still wakes up once per timer.
+ * Wakeups are kept few for the sake of idle machines: the warning is moved
+ * onto the tick grid (whole seconds before the deadline), and the timer
+ * slack of the timer thread can be raised (TimerEngine:slack), letting the
+ * kernel coalesce its wakeups with those of other threads.  Both threads
+ * count their wakeups in the engine-wakeups and tick-wakeups metrics.
+ * Deadlines are kept in monotonic time, converted from the wall-clock time
+ * when armed with TIMER_COMMAND_ARM_AT.  Steps of the wall clock don't move
+ * a countdown (DST doesn't change the wall-clock time anyway), but a timer
+ * armed for a wall-clock time (TIMER_ENGINE_MODE_CLOCK) keeps to it: where
+ * timerfd is available, a timerfd on CLOCK_REALTIME set for the deadline is
+ * cancelled by the kernel when the wall clock is set or the machine resumes,
+ * and the deadline is then converted again (see update_clock_source()).
+ * The clock is read through priv->clock (see timer-clock.h), so that tests
+ * can substitute their own, and deadlines can refer to a clock shared over
+ * the network (see timer-netclock.c).
+ *
+ *   Copyright (C) 2013 Christopher A. Doyle
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License along
+ *   with this program; if not, write to the Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "config.h"
+
+#ifdef HAVE_SYS_PRCTL_H
+#include <sys/prctl.h>
+#endif
+#ifdef HAVE_SYS_TIMERFD_H
+#include <errno.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+#include <glib-unix.h>
+#endif
+
+#include "timer-clock.h"
+#include "timer-engine.h"
+#include "timer-metrics.h"
+
+#define TIMER_NOT_ARMED (0)                  /* end_time value used when no timer is running */
+#define TIMER_ENGINE_DATA_KEY "timer-engine" /* key of the engine attached to its owner object */
+
+/* Structure defining data that is shared between the GUI thread and the timer_function thread. */
+typedef struct {
+  gboolean        new;            /* true indicates new data that timer_function thread hasn't processed yet */
+  gboolean        terminate;      /* true indicates that timer_function thread should terminate/exit */
+  gint64          end_time;       /* absolute (monotonic) time when the timer expires, or TIMER_NOT_ARMED */
+  gint64          end_time_real;  /* absolute (wall-clock) time when the timer expires, or TIMER_NOT_ARMED */
+  TimerEngineMode mode;           /* how the deadline was given */
+  GTimeSpan       warning_time;   /* how long before the expiry the warning is reported, 0 for no warning */
+  gboolean        warned;         /* true once the warning has been reported for the current deadline */
+  GTimeSpan       slack;          /* timer slack of the timer thread, 0 for the default of the system */
+  GTimeSpan       advance;        /* how long before the deadline the expiry is reported */
+  GSource        *warning_source; /* reporting the warning to the GUI thread, NULL if none pending */
+  GSource        *expired_source; /* reporting the expiry to the GUI thread, NULL if none pending */
+} SharedDataType;
+
+struct _TimerEnginePrivate {
+  /* Data shared between the GUI thread and the timer_function thread. */
+  SharedDataType        data_shared;
+  GMutex                data_mutex;
+  GCond                 data_cond;
+  const TimerClockType *clock;       /* read and waited on by both threads, see timer-clock.h */
+  gpointer              clock_data;
+
+  /* Data only used by the GUI thread. */
+  GThread              *timer_thread;
+  GMainContext         *context;     /* in which the signals are emitted */
+  GSource              *tick_source; /* emitting the tick signal, NULL while nobody subscribed or no timer runs */
+  guint                 tick_refs;   /* subscriptions from timer_engine_ref_tick() */
+  GSource              *clock_source; /* following the wall clock in TIMER_ENGINE_MODE_CLOCK, NULL if none */
+  gint                  clock_fd;     /* timerfd of clock_source, -1 if none */
+};
+
+enum {
+  PROP_0,
+  PROP_ARMED,
+  PROP_DEADLINE,
+  PROP_REMAINING,
+  PROP_MODE,
+  PROP_WARNING_TIME,
+  PROP_SLACK,
+  PROP_ADVANCE,
+  N_PROPERTIES
+};
+
+enum {
+  SIGNAL_ARMED,
+  SIGNAL_CANCELLED,
+  SIGNAL_WARNING,
+  SIGNAL_EXPIRED,
+  SIGNAL_TICK,
+  N_SIGNALS
+};
+
+static GParamSpec *properties[N_PROPERTIES] = { NULL, };
+static guint       signals[N_SIGNALS]       = { 0, };
+
+G_DEFINE_TYPE_WITH_PRIVATE(TimerEngine, timer_engine, G_TYPE_OBJECT)
+
+
+static gint64
+system_monotonic_time(gpointer user_data) {
+  return g_get_monotonic_time();
+}
+
+
+static gint64
+system_real_time(gpointer user_data) {
+  return g_get_real_time();
+}
+
+
+static gboolean
+system_wait_until(GCond *cond, GMutex *mutex, gint64 end_time, gpointer user_data) {
+  return g_cond_wait_until(cond, mutex, end_time);
+}
+
+static const TimerClockType systemClock = {
+  system_monotonic_time,
+  system_real_time,
+  system_wait_until
+};
+
+/* Read the clock of the engine.  Called with data_mutex held. */
+#define NOW_MONOTONIC(priv) ((priv)->clock->get_monotonic_time((priv)->clock_data))
+#define NOW_REAL(priv)      ((priv)->clock->get_real_time((priv)->clock_data))
+
+
+GType
+timer_engine_mode_get_type(void) {
+  static gsize type_id = 0;
+
+  if (g_once_init_enter(&type_id)) {
+    static const GEnumValue values[] = {
+      { TIMER_ENGINE_MODE_COUNTDOWN, "TIMER_ENGINE_MODE_COUNTDOWN", "countdown" },
+      { TIMER_ENGINE_MODE_CLOCK,     "TIMER_ENGINE_MODE_CLOCK",     "clock"     },
+      { 0, NULL, NULL }
+    };
+    g_once_init_leave(&type_id, g_enum_register_static("TimerEngineMode", values));
+  }
+  return type_id;
+}
+
+
+/* Report an event to the GUI thread, unless one is already pending.  Called with data_mutex held. */
+static void
+report_event(TimerEngine *engine, GSource **source, GSourceFunc func) {
+  if (*source) {
+    return;
+  }
+  *source = g_idle_source_new();
+  g_source_set_priority(*source, G_PRIORITY_HIGH);
+  g_source_set_callback(*source, func, engine, NULL);
+  g_source_attach(*source, engine->priv->context);
+}
+
+
+/* Drop an event that has not been reported yet.  Called with data_mutex held. */
+static void
+drop_event(GSource **source) {
+  if (*source) {
+    g_source_destroy(*source);
+    g_source_unref(*source);
+    *source = NULL;
+  }
+}
+
+
+/* The tick source only becomes ready at its ready time (see update_tick()). */
+static gboolean
+tick_source_dispatch(GSource *source, GSourceFunc callback, gpointer user_data) {
+  return callback(user_data);
+}
+
+static GSourceFuncs tickSourceFuncs = {
+  NULL, /* prepare */
+  NULL, /* check */
+  tick_source_dispatch,
+  NULL  /* finalize */
+};
+
+static gboolean timer_tick(TimerEngine *engine);
+
+
+/* Arm the tick source for the next whole second before the deadline, or drop it if the timer is not running
+   or nobody subscribed to the tick.  Runs on the GUI thread. */
+static void
+update_tick(TimerEngine *engine) {
+  TimerEnginePrivate *priv = engine->priv;
+  gint64              end_time;
+  gint64              now;
+  gint64              next;
+
+  /* in the time of the engine's clock, like end_time */
+  g_mutex_lock(&priv->data_mutex);
+  end_time = priv->data_shared.end_time;
+  now      = NOW_MONOTONIC(priv);
+  g_mutex_unlock(&priv->data_mutex);
+
+  next = end_time - ((end_time - now) / G_TIME_SPAN_SECOND) * G_TIME_SPAN_SECOND;
+
+  if ((end_time == TIMER_NOT_ARMED) || (next >= end_time) || (priv->tick_refs == 0)) {
+    if (priv->tick_source) {
+      g_source_destroy(priv->tick_source);
+      g_source_unref(priv->tick_source);
+      priv->tick_source = NULL;
+    }
+    return;
+  }
+
+  if (!priv->tick_source) {
+    priv->tick_source = g_source_new(&tickSourceFuncs, sizeof(GSource));
+    g_source_set_callback(priv->tick_source, (GSourceFunc) timer_tick, engine, NULL);
+    g_source_attach(priv->tick_source, priv->context);
+  }
+  g_source_set_ready_time(priv->tick_source, g_get_monotonic_time() + (next - now)); /* the main loop waits in system time */
+}
+
+
+#ifdef HAVE_SYS_TIMERFD_H
+static gboolean clock_changed(gint fd, GIOCondition condition, TimerEngine *engine);
+#endif
+
+
+/* While the timer runs in TIMER_ENGINE_MODE_CLOCK, keep a timerfd on CLOCK_REALTIME set for the deadline
+   (in system time, for an injected clock), cancelled by the kernel when the wall clock is set or the machine
+   resumes (TFD_TIMER_CANCEL_ON_SET): either way clock_changed() converts the deadline again.  Drop it
+   otherwise.  Runs on the GUI thread. */
+static void
+update_clock_source(TimerEngine *engine) {
+#ifdef HAVE_SYS_TIMERFD_H
+  TimerEnginePrivate *priv = engine->priv;
+  struct itimerspec   spec = { { 0, 0 }, { 0, 0 } };
+  gint64              end_time_real;
+  GTimeSpan           remaining;
+  gint64              target;
+
+  g_mutex_lock(&priv->data_mutex);
+  end_time_real = priv->data_shared.end_time_real;
+  remaining     = end_time_real - NOW_REAL(priv);
+  if ((priv->data_shared.end_time == TIMER_NOT_ARMED) || (priv->data_shared.mode != TIMER_ENGINE_MODE_CLOCK)) {
+    end_time_real = TIMER_NOT_ARMED;
+  }
+  g_mutex_unlock(&priv->data_mutex);
+
+  if (end_time_real == TIMER_NOT_ARMED) {
+    if (priv->clock_source) {
+      g_source_destroy(priv->clock_source);
+      g_source_unref(priv->clock_source);
+      priv->clock_source = NULL;
+      close(priv->clock_fd);
+      priv->clock_fd = -1;
+    }
+    return;
+  }
+
+  if (!priv->clock_source) {
+    priv->clock_fd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (priv->clock_fd < 0) {
+      g_warning("Timer: could not follow the wall clock: %s", g_strerror(errno));
+      return;
+    }
+    priv->clock_source = g_unix_fd_source_new(priv->clock_fd, G_IO_IN);
+    g_source_set_callback(priv->clock_source, (GSourceFunc) clock_changed, engine, NULL);
+    g_source_attach(priv->clock_source, priv->context);
+  }
+
+  /* a deadline already passed is left to the timer thread (the timerfd stays disarmed) */
+  if (remaining > 0) {
+    target                = g_get_real_time() + remaining;
+    spec.it_value.tv_sec  = target / G_USEC_PER_SEC;
+    spec.it_value.tv_nsec = (target % G_USEC_PER_SEC) * 1000;
+  }
+  if (timerfd_settime(priv->clock_fd, TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET, &spec, NULL) < 0) {
+    g_warning("Timer: could not follow the wall clock: %s", g_strerror(errno));
+  }
+#endif
+}
+
+
+#ifdef HAVE_SYS_TIMERFD_H
+/* The timerfd of update_clock_source() fired (the deadline came in system time) or was cancelled (ECANCELED:
+   the wall clock was set, or the machine resumed).  Convert the wall-clock deadline to monotonic time again.
+   Runs on the GUI thread. */
+static gboolean
+clock_changed(gint fd, GIOCondition condition, TimerEngine *engine) {
+  TimerEnginePrivate *priv = engine->priv;
+  guint64             expirations;
+
+  if ((read(fd, &expirations, sizeof(expirations)) < 0) && (errno == EAGAIN)) {
+    return G_SOURCE_CONTINUE;
+  }
+
+  g_mutex_lock(&priv->data_mutex);
+  if ((priv->data_shared.end_time != TIMER_NOT_ARMED) && (priv->data_shared.mode == TIMER_ENGINE_MODE_CLOCK)) {
+    priv->data_shared.end_time = NOW_MONOTONIC(priv) + (priv->data_shared.end_time_real - NOW_REAL(priv));
+    priv->data_shared.new      = TRUE;  /* let the timer thread wait for the new deadline */
+    g_cond_signal(&priv->data_cond);  /* hold lock before signalling */
+  }
+  g_mutex_unlock(&priv->data_mutex);
+
+  update_tick(engine);
+  update_clock_source(engine);
+  return G_SOURCE_CONTINUE;
+}
+#endif
+
+
+/* Runs on the GUI thread at every whole second before the deadline while the tick is subscribed to. */
+static gboolean
+timer_tick(TimerEngine *engine) {
+  GTimeSpan remaining = timer_engine_get_remaining(engine);
+
+  timer_metrics_add("tick-wakeups", 1);
+  update_tick(engine);
+  if (remaining > 0) {
+    g_signal_emit(engine, signals[SIGNAL_TICK], 0, (remaining + G_TIME_SPAN_SECOND/2) / G_TIME_SPAN_SECOND);
+  }
+  return G_SOURCE_CONTINUE;
+}
+
+
+/* Runs on the GUI thread after the timer_function thread detected that the warning time was reached. */
+static gboolean
+timer_warning(TimerEngine *engine) {
+  TimerEnginePrivate *priv = engine->priv;
+  gboolean            armed;
+
+  g_mutex_lock(&priv->data_mutex);
+  g_source_unref(priv->data_shared.warning_source);
+  priv->data_shared.warning_source = NULL;
+  armed = (priv->data_shared.end_time != TIMER_NOT_ARMED);
+  g_mutex_unlock(&priv->data_mutex);
+
+  if (armed) {
+    g_signal_emit(engine, signals[SIGNAL_WARNING], 0);
+  }
+  return G_SOURCE_REMOVE;
+}
+
+
+/* Runs on the GUI thread after the timer_function thread detected the expiry of the timer. */
+static gboolean
+timer_expired(TimerEngine *engine) {
+  TimerEnginePrivate *priv = engine->priv;
+
+  g_mutex_lock(&priv->data_mutex);
+  g_source_unref(priv->data_shared.expired_source);
+  priv->data_shared.expired_source = NULL;
+  g_mutex_unlock(&priv->data_mutex);
+
+  update_tick(engine);
+  update_clock_source(engine);
+
+  g_object_freeze_notify(G_OBJECT(engine));
+  g_object_notify_by_pspec(G_OBJECT(engine), properties[PROP_ARMED]);
+  g_object_notify_by_pspec(G_OBJECT(engine), properties[PROP_DEADLINE]);
+  g_object_thaw_notify(G_OBJECT(engine));
+
+  g_signal_emit(engine, signals[SIGNAL_EXPIRED], 0);
+  return G_SOURCE_REMOVE;
+}
+
+
+/* Set the timer slack (in microseconds, 0 for the default) of the calling thread, unless already set.
+   Runs on the timer_function thread. */
+static void
+apply_slack(GTimeSpan slack, GTimeSpan *applied) {
+  if (slack == *applied) {
+    return;
+  }
+#ifdef HAVE_SYS_PRCTL_H
+  /* a slack of 0 restores the default slack of the thread */
+  if (prctl(PR_SET_TIMERSLACK, (unsigned long) slack * 1000, 0, 0, 0) < 0) {
+    g_warning("Timer: could not set the timer slack to %" G_GINT64_FORMAT " us", slack);
+  }
+#endif
+  *applied = slack;
+}
+
+
+/* Returns the (monotonic) time the expiry is reported at, i.e. the deadline less the advance.
+   Called with data_mutex held while the timer runs. */
+static gint64
+expiry_time(const SharedDataType *data_shared) {
+  return data_shared->end_time - data_shared->advance;
+}
+
+
+/* Returns the (monotonic) time the timer thread must wake up at next: the expiry, or the warning before it.
+   Called with data_mutex held while the timer runs. */
+static gint64
+next_wake_time(const SharedDataType *data_shared) {
+  gint64    wake_time = data_shared->end_time;
+  GTimeSpan lead;
+
+  if ((data_shared->warning_time > 0) && (!data_shared->warned)) {
+    /* the warning isn't critical: report it at the tick before, rather than waking up on its own */
+    lead       = (data_shared->warning_time + G_TIME_SPAN_SECOND - 1) / G_TIME_SPAN_SECOND;
+    wake_time -= lead * G_TIME_SPAN_SECOND;
+  }
+  return MIN(wake_time, expiry_time(data_shared));
+}
+
+
+/* Thread implementing the timer. */
+static void *
+timer_function(TimerEngine *engine) {
+  TimerEnginePrivate *priv        = engine->priv;
+  SharedDataType     *data_shared = &priv->data_shared;
+  gint64              wake_time;  /* absolute (monotonic) time of the next warning or expiry */
+  GTimeSpan           slack = 0;  /* timer slack currently set for this thread */
+
+  g_mutex_lock(&priv->data_mutex);
+
+  do {
+    /* wait until new data arrives */
+    while (!data_shared->new) {
+      g_cond_wait(&priv->data_cond, &priv->data_mutex);
+      timer_metrics_add("engine-wakeups", 1);
+    }
+    /* we have received a signal indicating new data */
+    data_shared->new = FALSE;  /* acknowledge the new data */
+    apply_slack(data_shared->slack, &slack);
+
+    while ((!data_shared->terminate) && (data_shared->end_time != TIMER_NOT_ARMED)) {
+      while (!data_shared->new) {
+        wake_time = next_wake_time(data_shared);
+
+        if (!priv->clock->wait_until(&priv->data_cond, &priv->data_mutex, wake_time, priv->clock_data)) {
+          timer_metrics_add("engine-wakeups", 1);
+          if (wake_time != expiry_time(data_shared)) {
+            /* warning time has passed, report it to the GUI thread and keep on waiting. */
+            data_shared->warned = TRUE;
+            report_event(engine, &data_shared->warning_source, (GSourceFunc) timer_warning);
+            continue;
+          }
+          /* timeout has passed, report it to the GUI thread and wait for new data. */
+          data_shared->end_time      = TIMER_NOT_ARMED;
+          data_shared->end_time_real = TIMER_NOT_ARMED;
+          report_event(engine, &data_shared->expired_source, (GSourceFunc) timer_expired);
+          break;
+        }
+        timer_metrics_add("engine-wakeups", 1);
+      }
+      /* we have received a signal indicating new data */
+      data_shared->new = FALSE;  /* acknowledge the new data */
+      apply_slack(data_shared->slack, &slack);
+    }
+  } while (!data_shared->terminate);
+
+  /* the signal indicated that we should terminate */
+  g_mutex_unlock(&priv->data_mutex);
+  g_thread_exit(NULL);
+  return NULL; /* will never get here */
+}
+
+
+static void
+timer_engine_init(TimerEngine *engine) {
+  TimerEnginePrivate *priv;
+
+  engine->priv = priv = timer_engine_get_instance_private(engine);
+
+  g_mutex_init(&priv->data_mutex);
+  g_cond_init(&priv->data_cond);
+
+  /* Make sure shared data is in sane state before starting timer thread. */
+  priv->data_shared.new           = FALSE;
+  priv->data_shared.terminate     = FALSE;
+  priv->data_shared.end_time      = TIMER_NOT_ARMED;
+  priv->data_shared.end_time_real = TIMER_NOT_ARMED;
+  priv->data_shared.mode          = TIMER_ENGINE_MODE_COUNTDOWN;
+  priv->data_shared.warning_time  = 0;
+  priv->data_shared.warned        = FALSE;
+  priv->data_shared.slack         = 0;
+  priv->data_shared.advance       = 0;
+  priv->clock                     = &systemClock;
+  priv->clock_data                = NULL;
+  priv->clock_fd                  = -1;
+
+  priv->context = g_main_context_ref_thread_default();
+
+  /* g_thread_new() causes program abort if thread can not be created */
+  priv->timer_thread = g_thread_new("tTimerThread", (GThreadFunc) timer_function, engine);
+}
+
+
+static void
+timer_engine_dispose(GObject *object) {
+  TimerEnginePrivate *priv = TIMER_ENGINE(object)->priv;
+
+  if (priv->timer_thread) {
+    /* Tell the timer thread to exit gracefully and wait for it. */
+    g_mutex_lock(&priv->data_mutex);
+    priv->data_shared.new       = TRUE;
+    priv->data_shared.terminate = TRUE;
+    g_cond_signal(&priv->data_cond);  /* hold lock before signalling */
+    g_mutex_unlock(&priv->data_mutex);
+    g_thread_join(priv->timer_thread);  /* g_thread_join() also does a g_thread_unref() too */
+    priv->timer_thread = NULL;
+
+    /* Drop events that have not been reported yet. */
+    drop_event(&priv->data_shared.warning_source);
+    drop_event(&priv->data_shared.expired_source);
+  }
+
+  if (priv->tick_source) {
+    g_source_destroy(priv->tick_source);
+    g_source_unref(priv->tick_source);
+    priv->tick_source = NULL;
+  }
+
+#ifdef HAVE_SYS_TIMERFD_H
+  if (priv->clock_source) {
+    g_source_destroy(priv->clock_source);
+    g_source_unref(priv->clock_source);
+    priv->clock_source = NULL;
+    close(priv->clock_fd);
+    priv->clock_fd = -1;
+  }
+#endif
+
+  G_OBJECT_CLASS(timer_engine_parent_class)->dispose(object);
+}
+
+
+static void
+timer_engine_finalize(GObject *object) {
+  TimerEnginePrivate *priv = TIMER_ENGINE(object)->priv;
+
+  g_main_context_unref(priv->context);
+  g_cond_clear(&priv->data_cond);
+  g_mutex_clear(&priv->data_mutex);
+
+  G_OBJECT_CLASS(timer_engine_parent_class)->finalize(object);
+}
+
+
+static void
+timer_engine_get_property(GObject *object, guint property_id, GValue *value, GParamSpec *pspec) {
+  TimerEngine *engine = TIMER_ENGINE(object);
+
+  switch (property_id) {
+  case PROP_ARMED:
+    g_value_set_boolean(value, timer_engine_is_armed(engine));
+    break;
+  case PROP_DEADLINE:
+    g_value_set_int64(value, timer_engine_get_deadline(engine));
+    break;
+  case PROP_REMAINING:
+    g_value_set_int64(value, timer_engine_get_remaining(engine));
+    break;
+  case PROP_MODE:
+    g_value_set_enum(value, timer_engine_get_mode(engine));
+    break;
+  case PROP_WARNING_TIME:
+    g_value_set_int64(value, timer_engine_get_warning_time(engine));
+    break;
+  case PROP_SLACK:
+    g_value_set_int64(value, timer_engine_get_slack(engine));
+    break;
+  case PROP_ADVANCE:
+    g_value_set_int64(value, timer_engine_get_advance(engine));
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
+    break;
+  }
+}
+
+
+static void
+timer_engine_set_property(GObject *object, guint property_id, const GValue *value, GParamSpec *pspec) {
+  TimerEngine *engine = TIMER_ENGINE(object);
+
+  switch (property_id) {
+  case PROP_WARNING_TIME:
+    timer_engine_set_warning_time(engine, g_value_get_int64(value));
+    break;
+  case PROP_SLACK:
+    timer_engine_set_slack(engine, g_value_get_int64(value));
+    break;
+  case PROP_ADVANCE:
+    timer_engine_set_advance(engine, g_value_get_int64(value));
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
+    break;
+  }
+}
+
+
+static void
+timer_engine_class_init(TimerEngineClass *klass) {
+  GObjectClass *object_class = G_OBJECT_CLASS(klass);
+
+  object_class->dispose      = timer_engine_dispose;
+  object_class->finalize     = timer_engine_finalize;
+  object_class->get_property = timer_engine_get_property;
+  object_class->set_property = timer_engine_set_property;
+
+  /**
+   * TimerEngine:armed:
+   *
+   * Whether the timer is running.
+   */
+  properties[PROP_ARMED] =
+    g_param_spec_boolean("armed", "Armed", "Whether the timer is running",
+                         FALSE,
+                         G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+
+  /**
+   * TimerEngine:deadline:
+   *
+   * Wall-clock time (as per g_get_real_time()) at which the timer expires, 0 if the timer is not running.
+   */
+  properties[PROP_DEADLINE] =
+    g_param_spec_int64("deadline", "Deadline", "Wall-clock time at which the timer expires",
+                       0, G_MAXINT64, 0,
+                       G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+
+  /**
+   * TimerEngine:remaining:
+   *
+   * Time (in microseconds) until the timer expires, 0 if the timer is not running.
+   * This property changes continuously and is therefore never notified.
+   */
+  properties[PROP_REMAINING] =
+    g_param_spec_int64("remaining", "Remaining", "Time until the timer expires",
+                       0, G_MAXINT64, 0,
+                       G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+
+  /**
+   * TimerEngine:mode:
+   *
+   * How the deadline of the timer was given.
+   */
+  properties[PROP_MODE] =
+    g_param_spec_enum("mode", "Mode", "How the deadline of the timer was given",
+                      TIMER_TYPE_ENGINE_MODE, TIMER_ENGINE_MODE_COUNTDOWN,
+                      G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+
+  /**
+   * TimerEngine:warning-time:
+   *
+   * How long (in microseconds) before the expiry #TimerEngine::warning is emitted, 0 for no warning.
+   */
+  properties[PROP_WARNING_TIME] =
+    g_param_spec_int64("warning-time", "Warning time", "How long before the expiry the warning is emitted",
+                       0, G_MAXINT64, 0,
+                       G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+
+  /**
+   * TimerEngine:slack:
+   *
+   * How late (in microseconds) the timer thread may wake up, letting the system coalesce its wakeups with
+   * others; 0 for the default of the system.  Only honoured where the system supports it (Linux).
+   */
+  properties[PROP_SLACK] =
+    g_param_spec_int64("slack", "Slack", "How late the timer thread may wake up",
+                       0, G_MAXINT64, 0,
+                       G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+
+  /**
+   * TimerEngine:advance:
+   *
+   * How long (in microseconds) before the deadline #TimerEngine::expired is emitted, e.g. to make up for the
+   * time the expiry takes to show; 0 to expire at the deadline.  The deadline itself is not affected.
+   */
+  properties[PROP_ADVANCE] =
+    g_param_spec_int64("advance", "Advance", "How long before the deadline the expiry is emitted",
+                       0, G_MAXINT64, 0,
+                       G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+
+  g_object_class_install_properties(object_class, N_PROPERTIES, properties);
+
+  /**
+   * TimerEngine::armed:
+   * @engine: the engine
+   *
+   * Emitted when the timer is started, restarted or extended.
+   */
+  signals[SIGNAL_ARMED] =
+    g_signal_new("armed", G_TYPE_FROM_CLASS(klass), G_SIGNAL_RUN_LAST,
+                 G_STRUCT_OFFSET(TimerEngineClass, armed),
+                 NULL, NULL, NULL, G_TYPE_NONE, 0);
+
+  /**
+   * TimerEngine::cancelled:
+   * @engine: the engine
+   *
+   * Emitted when the running timer is cancelled.
+   */
+  signals[SIGNAL_CANCELLED] =
+    g_signal_new("cancelled", G_TYPE_FROM_CLASS(klass), G_SIGNAL_RUN_LAST,
+                 G_STRUCT_OFFSET(TimerEngineClass, cancelled),
+                 NULL, NULL, NULL, G_TYPE_NONE, 0);
+
+  /**
+   * TimerEngine::warning:
+   * @engine: the engine
+   *
+   * Emitted #TimerEngine:warning-time before the timer expires.
+   */
+  signals[SIGNAL_WARNING] =
+    g_signal_new("warning", G_TYPE_FROM_CLASS(klass), G_SIGNAL_RUN_LAST,
+                 G_STRUCT_OFFSET(TimerEngineClass, warning),
+                 NULL, NULL, NULL, G_TYPE_NONE, 0);
+
+  /**
+   * TimerEngine::expired:
+   * @engine: the engine
+   *
+   * Emitted when the timer expires.
+   */
+  signals[SIGNAL_EXPIRED] =
+    g_signal_new("expired", G_TYPE_FROM_CLASS(klass), G_SIGNAL_RUN_LAST,
+                 G_STRUCT_OFFSET(TimerEngineClass, expired),
+                 NULL, NULL, NULL, G_TYPE_NONE, 0);
+
+  /**
+   * TimerEngine::tick:
+   * @engine: the engine
+   * @remaining: whole seconds until the timer expires
+   *
+   * Emitted every second while the timer runs, at whole seconds before the deadline,
+   * and only while subscribed to: connecting a handler isn't enough, call
+   * timer_engine_ref_tick() along with it (and timer_engine_unref_tick() when
+   * done).  The tick then runs right away, including for a timer already running.
+   */
+  signals[SIGNAL_TICK] =
+    g_signal_new("tick", G_TYPE_FROM_CLASS(klass), G_SIGNAL_RUN_LAST,
+                 G_STRUCT_OFFSET(TimerEngineClass, tick),
+                 NULL, NULL, NULL, G_TYPE_NONE, 1, G_TYPE_INT64);
+}
+
+
+/**
+ * timer_engine_new:
+ *
+ * Creates an engine and starts its timer thread.  Signals are emitted in the
+ * thread-default main context of the caller, which is also where commands
+ * must be issued from.
+ *
+ * Returns: (transfer full): a new #TimerEngine
+ */
+TimerEngine *
+timer_engine_new(void) {
+  return g_object_new(TIMER_TYPE_ENGINE, NULL);
+}
+
+
+/**
+ * timer_engine_command:
+ * @engine: a #TimerEngine
+ * @command: the command to apply
+ * @value: timeout (in microseconds) or wall-clock time, see #TimerCommandType
+ *
+ * Applies a command to the timer.
+ *
+ * Returns: %FALSE if the command was rejected (e.g. extending a timer that is not running)
+ */
+gboolean
+timer_engine_command(TimerEngine *engine, TimerCommandType command, gint64 value) {
+  TimerEnginePrivate *priv;
+  SharedDataType     *data_shared;
+  gboolean            accepted = TRUE;
+  gboolean            was_armed;
+  gint64              old_deadline;
+  TimerEngineMode     old_mode;
+  gint64              now_real;
+
+  g_return_val_if_fail(TIMER_IS_ENGINE(engine), FALSE);
+
+  priv        = engine->priv;
+  data_shared = &priv->data_shared;
+
+  g_mutex_lock(&priv->data_mutex);
+  was_armed    = (data_shared->end_time != TIMER_NOT_ARMED);
+  old_deadline = data_shared->end_time_real;
+  old_mode     = data_shared->mode;
+
+  switch (command) {
+  case TIMER_COMMAND_ARM:
+    if (value > 0) {
+      data_shared->end_time      = NOW_MONOTONIC(priv) + value;
+      data_shared->end_time_real = NOW_REAL(priv) + value;
+      data_shared->mode          = TIMER_ENGINE_MODE_COUNTDOWN;
+    } else {
+      accepted = FALSE;
+    }
+    break;
+
+  case TIMER_COMMAND_ARM_AT:
+    now_real = NOW_REAL(priv);
+    if (value > now_real) {
+      data_shared->end_time      = NOW_MONOTONIC(priv) + (value - now_real);
+      data_shared->end_time_real = value;
+      data_shared->mode          = TIMER_ENGINE_MODE_CLOCK;
+    } else {
+      accepted = FALSE;
+    }
+    break;
+
+  case TIMER_COMMAND_CANCEL:
+    data_shared->end_time      = TIMER_NOT_ARMED;
+    data_shared->end_time_real = TIMER_NOT_ARMED;
+    break;
+
+  case TIMER_COMMAND_EXTEND:
+    if ((value > 0) && was_armed) {
+      data_shared->end_time      += value;
+      data_shared->end_time_real += value;
+    } else {
+      accepted = FALSE;
+    }
+    break;
+
+  case TIMER_COMMAND_EXPIRE:
+    if (was_armed) {
+      data_shared->end_time      = TIMER_NOT_ARMED;
+      data_shared->end_time_real = TIMER_NOT_ARMED;
+    } else {
+      accepted = FALSE;
+    }
+    break;
+
+  default:
+    accepted = FALSE;
+    break;
+  }
+
+  if (accepted) {
+    /* a new deadline gets a new warning, and an expiry not reported yet is superseded by the command */
+    data_shared->warned = FALSE;
+    drop_event(&data_shared->warning_source);
+    drop_event(&data_shared->expired_source);
+
+    data_shared->new       = TRUE;
+    data_shared->terminate = FALSE;
+    g_cond_signal(&priv->data_cond);  /* hold lock before signalling */
+  }
+  g_mutex_unlock(&priv->data_mutex);
+
+  if (!accepted) {
+    return FALSE;
+  }
+
+  g_object_freeze_notify(G_OBJECT(engine));
+  if (was_armed != timer_engine_is_armed(engine)) {
+    g_object_notify_by_pspec(G_OBJECT(engine), properties[PROP_ARMED]);
+  }
+  if (old_deadline != timer_engine_get_deadline(engine)) {
+    g_object_notify_by_pspec(G_OBJECT(engine), properties[PROP_DEADLINE]);
+  }
+  if (old_mode != timer_engine_get_mode(engine)) {
+    g_object_notify_by_pspec(G_OBJECT(engine), properties[PROP_MODE]);
+  }
+  g_object_thaw_notify(G_OBJECT(engine));
+
+  update_tick(engine);
+  update_clock_source(engine);
+
+  switch (command) {
+  case TIMER_COMMAND_ARM:
+  case TIMER_COMMAND_ARM_AT:
+  case TIMER_COMMAND_EXTEND:
+    g_signal_emit(engine, signals[SIGNAL_ARMED], 0);
+    break;
+  case TIMER_COMMAND_CANCEL:
+    if (was_armed) {
+      g_signal_emit(engine, signals[SIGNAL_CANCELLED], 0);
+    }
+    break;
+  case TIMER_COMMAND_EXPIRE:
+    g_signal_emit(engine, signals[SIGNAL_EXPIRED], 0);
+    break;
+  default:
+    break;
+  }
+  return TRUE;
+}
+
+
+gboolean
+timer_engine_is_armed(TimerEngine *engine) {
+  gboolean armed;
+
+  g_mutex_lock(&engine->priv->data_mutex);
+  armed = (engine->priv->data_shared.end_time != TIMER_NOT_ARMED);
+  g_mutex_unlock(&engine->priv->data_mutex);
+
+  return armed;
+}
+
+
+/* Returns the wall-clock time (as per g_get_real_time()) at which the timer expires,
+   or 0 if the timer is not running. */
+gint64
+timer_engine_get_deadline(TimerEngine *engine) {
+  gint64 deadline;
+
+  g_mutex_lock(&engine->priv->data_mutex);
+  deadline = engine->priv->data_shared.end_time_real;
+  g_mutex_unlock(&engine->priv->data_mutex);
+
+  return deadline;
+}
+
+
+/* Returns the wall-clock time now, as read by the clock of the engine (the time TIMER_COMMAND_ARM_AT refers to). */
+gint64
+timer_engine_get_time(TimerEngine *engine) {
+  gint64 now;
+
+  g_mutex_lock(&engine->priv->data_mutex);
+  now = NOW_REAL(engine->priv);
+  g_mutex_unlock(&engine->priv->data_mutex);
+
+  return now;
+}
+
+
+/* Returns the time (in microseconds) until the timer expires, or 0 if the timer is not running. */
+GTimeSpan
+timer_engine_get_remaining(TimerEngine *engine) {
+  GTimeSpan remaining = 0;
+
+  g_mutex_lock(&engine->priv->data_mutex);
+  if (engine->priv->data_shared.end_time != TIMER_NOT_ARMED) {
+    remaining = MAX(0, engine->priv->data_shared.end_time - NOW_MONOTONIC(engine->priv));
+  }
+  g_mutex_unlock(&engine->priv->data_mutex);
+
+  return remaining;
+}
+
+
+TimerEngineMode
+timer_engine_get_mode(TimerEngine *engine) {
+  TimerEngineMode mode;
+
+  g_mutex_lock(&engine->priv->data_mutex);
+  mode = engine->priv->data_shared.mode;
+  g_mutex_unlock(&engine->priv->data_mutex);
+
+  return mode;
+}
+
+
+GTimeSpan
+timer_engine_get_warning_time(TimerEngine *engine) {
+  GTimeSpan warning_time;
+
+  g_mutex_lock(&engine->priv->data_mutex);
+  warning_time = engine->priv->data_shared.warning_time;
+  g_mutex_unlock(&engine->priv->data_mutex);
+
+  return warning_time;
+}
+
+
+void
+timer_engine_set_warning_time(TimerEngine *engine, GTimeSpan warning_time) {
+  TimerEnginePrivate *priv;
+
+  g_return_if_fail(TIMER_IS_ENGINE(engine));
+
+  priv         = engine->priv;
+  warning_time = MAX(0, warning_time);
+
+  g_mutex_lock(&priv->data_mutex);
+  if (priv->data_shared.warning_time == warning_time) {
+    g_mutex_unlock(&priv->data_mutex);
+    return;
+  }
+  priv->data_shared.warning_time = warning_time;
+  priv->data_shared.new          = TRUE;  /* let the timer thread recompute its wakeup */
+  g_cond_signal(&priv->data_cond);  /* hold lock before signalling */
+  g_mutex_unlock(&priv->data_mutex);
+
+  g_object_notify_by_pspec(G_OBJECT(engine), properties[PROP_WARNING_TIME]);
+}
+
+
+/* Replace the clock of engine (see timer-clock.h), or restore the system clock if clock is NULL.
+   The clock should be set before the first command: a running countdown keeps its monotonic deadline. */
+void
+timer_engine_set_clock(TimerEngine *engine, const TimerClockType *clock, gpointer user_data) {
+  TimerEnginePrivate *priv;
+
+  g_return_if_fail(TIMER_IS_ENGINE(engine));
+
+  priv = engine->priv;
+
+  g_mutex_lock(&priv->data_mutex);
+  priv->clock           = clock ? clock : &systemClock;
+  priv->clock_data      = clock ? user_data : NULL;
+  priv->data_shared.new = TRUE;  /* let the timer thread wait on the new clock */
+  g_cond_signal(&priv->data_cond);  /* hold lock before signalling */
+  g_mutex_unlock(&priv->data_mutex);
+
+  update_clock_source(engine);
+}
+
+
+GTimeSpan
+timer_engine_get_slack(TimerEngine *engine) {
+  GTimeSpan slack;
+
+  g_mutex_lock(&engine->priv->data_mutex);
+  slack = engine->priv->data_shared.slack;
+  g_mutex_unlock(&engine->priv->data_mutex);
+
+  return slack;
+}
+
+
+void
+timer_engine_set_slack(TimerEngine *engine, GTimeSpan slack) {
+  TimerEnginePrivate *priv;
+
+  g_return_if_fail(TIMER_IS_ENGINE(engine));
+
+  priv  = engine->priv;
+  slack = MAX(0, slack);
+
+  g_mutex_lock(&priv->data_mutex);
+  if (priv->data_shared.slack == slack) {
+    g_mutex_unlock(&priv->data_mutex);
+    return;
+  }
+  priv->data_shared.slack = slack;
+  priv->data_shared.new   = TRUE;  /* let the timer thread apply it */
+  g_cond_signal(&priv->data_cond);  /* hold lock before signalling */
+  g_mutex_unlock(&priv->data_mutex);
+
+  g_object_notify_by_pspec(G_OBJECT(engine), properties[PROP_SLACK]);
+}
+
+
+GTimeSpan
+timer_engine_get_advance(TimerEngine *engine) {
+  GTimeSpan advance;
+
+  g_mutex_lock(&engine->priv->data_mutex);
+  advance = engine->priv->data_shared.advance;
+  g_mutex_unlock(&engine->priv->data_mutex);
+
+  return advance;
+}
+
+
+void
+timer_engine_set_advance(TimerEngine *engine, GTimeSpan advance) {
+  TimerEnginePrivate *priv;
+
+  g_return_if_fail(TIMER_IS_ENGINE(engine));
+
+  priv    = engine->priv;
+  advance = MAX(0, advance);
+
+  g_mutex_lock(&priv->data_mutex);
+  if (priv->data_shared.advance == advance) {
+    g_mutex_unlock(&priv->data_mutex);
+    return;
+  }
+  priv->data_shared.advance = advance;
+  priv->data_shared.new     = TRUE;  /* let the timer thread recompute its wakeup */
+  g_cond_signal(&priv->data_cond);  /* hold lock before signalling */
+  g_mutex_unlock(&priv->data_mutex);
+
+  g_object_notify_by_pspec(G_OBJECT(engine), properties[PROP_ADVANCE]);
+}
+
+
+/**
+ * timer_engine_attach:
+ * @engine: a #TimerEngine
+ * @owner: the object the engine belongs to, normally the #TotemObject
+ *
+ * Makes @engine available to other plugins through timer_engine_from_object().
+ */
+void
+timer_engine_attach(TimerEngine *engine, GObject *owner) {
+  g_object_set_data_full(owner, TIMER_ENGINE_DATA_KEY, g_object_ref(engine), g_object_unref);
+}
+
+
+/**
+ * timer_engine_detach:
+ * @engine: a #TimerEngine
+ * @owner: the object @engine was attached to
+ *
+ * Undoes timer_engine_attach().
+ */
+void
+timer_engine_detach(TimerEngine *engine, GObject *owner) {
+  if (g_object_get_data(owner, TIMER_ENGINE_DATA_KEY) == engine) {
+    g_object_set_data(owner, TIMER_ENGINE_DATA_KEY, NULL);
+  }
+}
+
+
+/**
+ * timer_engine_from_object:
+ * @owner: an object, normally the #TotemObject
+ *
+ * Returns: (transfer none) (nullable): the engine attached to @owner, or %NULL
+ */
+TimerEngine *
+timer_engine_from_object(GObject *owner) {
+  return g_object_get_data(owner, TIMER_ENGINE_DATA_KEY);
+}
+
+
+/**
+ * timer_engine_ref_tick:
+ * @engine: a #TimerEngine
+ *
+ * Subscribes to #TimerEngine::tick: the tick runs (from now on, should a timer
+ * already be running) until the matching timer_engine_unref_tick().
+ */
+void
+timer_engine_ref_tick(TimerEngine *engine) {
+  g_return_if_fail(TIMER_IS_ENGINE(engine));
+
+  engine->priv->tick_refs++;
+  update_tick(engine);
+}
+
+
+/**
+ * timer_engine_unref_tick:
+ * @engine: a #TimerEngine
+ *
+ * Ends a subscription taken with timer_engine_ref_tick().
+ */
+void
+timer_engine_unref_tick(TimerEngine *engine) {
+  g_return_if_fail(TIMER_IS_ENGINE(engine));
+  g_return_if_fail(engine->priv->tick_refs > 0);
+
+  engine->priv->tick_refs--;
+  update_tick(engine);
+}
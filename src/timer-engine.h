@@ -0,0 +1,121 @@
+/*
+ * timer-engine.h
+ * The timer engine: a GObject owning a thread that waits for the timer to
+ * expire.  State changes are announced through properties and signals,
+ * emitted on the main context the engine was created in.
+ * All commands (menu items, D-Bus, ...) that change the timer are routed
+ * through timer_engine_command().
+ *
+ *   Copyright (C) 2013 Christopher A. Doyle
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License along
+ *   with this program; if not, write to the Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef TIMER_ENGINE_H
+#define TIMER_ENGINE_H
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+/* Adjustable timer constants */
+#define TIMER_MIN (1)          /* minimum possible timeout value (in minutes) */
+#define TIMER_MAX (999)        /* maximum possible timeout value (in minutes) */
+#define TIMER_ADJ_DEFAULT (60) /* default timeout value (in minutes) for adjustable timer */
+
+typedef gint16 TimeType; /* Timeout value in minutes, normally between TIMER_MIN..TIMER_MAX. */
+
+#define TIMER_TYPE_ENGINE      (timer_engine_get_type())
+#define TIMER_ENGINE(o)        (G_TYPE_CHECK_INSTANCE_CAST((o), TIMER_TYPE_ENGINE, TimerEngine))
+#define TIMER_IS_ENGINE(o)     (G_TYPE_CHECK_INSTANCE_TYPE((o), TIMER_TYPE_ENGINE))
+#define TIMER_TYPE_ENGINE_MODE (timer_engine_mode_get_type())
+
+/**
+ * TimerCommandType:
+ * @TIMER_COMMAND_ARM: start/restart the timer, the value is the timeout in microseconds
+ * @TIMER_COMMAND_ARM_AT: start/restart the timer, the value is the wall-clock time of expiry (as per g_get_real_time())
+ * @TIMER_COMMAND_CANCEL: cancel the timer (the value is not used)
+ * @TIMER_COMMAND_EXTEND: add the value (in microseconds) to the running timer
+ * @TIMER_COMMAND_EXPIRE: expire the running timer now (the value is not used)
+ *
+ * Commands that change the state of the timer.
+ */
+typedef enum {
+  TIMER_COMMAND_ARM,
+  TIMER_COMMAND_ARM_AT,
+  TIMER_COMMAND_CANCEL,
+  TIMER_COMMAND_EXTEND,
+  TIMER_COMMAND_EXPIRE
+} TimerCommandType;
+
+/**
+ * TimerEngineMode:
+ * @TIMER_ENGINE_MODE_COUNTDOWN: the timer counts down a duration (armed with %TIMER_COMMAND_ARM)
+ * @TIMER_ENGINE_MODE_CLOCK: the timer expires at a wall-clock time (armed with %TIMER_COMMAND_ARM_AT)
+ *
+ * How the deadline of the timer was given.
+ */
+typedef enum {
+  TIMER_ENGINE_MODE_COUNTDOWN,
+  TIMER_ENGINE_MODE_CLOCK
+} TimerEngineMode;
+
+typedef struct _TimerEngine        TimerEngine;
+typedef struct _TimerEngineClass   TimerEngineClass;
+typedef struct _TimerEnginePrivate TimerEnginePrivate;
+
+struct _TimerEngine {
+  GObject             parent;
+  TimerEnginePrivate *priv;
+};
+
+struct _TimerEngineClass {
+  GObjectClass parent_class;
+
+  /* signals */
+  void (*armed)    (TimerEngine *engine);
+  void (*cancelled)(TimerEngine *engine);
+  void (*warning)  (TimerEngine *engine);
+  void (*expired)  (TimerEngine *engine);
+  void (*tick)     (TimerEngine *engine, gint64 remaining);
+};
+
+GType           timer_engine_get_type        (void) G_GNUC_CONST;
+GType           timer_engine_mode_get_type   (void) G_GNUC_CONST;
+
+TimerEngine    *timer_engine_new             (void);
+gboolean        timer_engine_command         (TimerEngine *engine, TimerCommandType command, gint64 value);
+gboolean        timer_engine_is_armed        (TimerEngine *engine);
+gint64          timer_engine_get_deadline    (TimerEngine *engine);
+gint64          timer_engine_get_time        (TimerEngine *engine);
+GTimeSpan       timer_engine_get_remaining   (TimerEngine *engine);
+TimerEngineMode timer_engine_get_mode        (TimerEngine *engine);
+GTimeSpan       timer_engine_get_warning_time(TimerEngine *engine);
+void            timer_engine_set_warning_time(TimerEngine *engine, GTimeSpan warning_time);
+GTimeSpan       timer_engine_get_slack       (TimerEngine *engine);
+void            timer_engine_set_slack       (TimerEngine *engine, GTimeSpan slack);
+GTimeSpan       timer_engine_get_advance     (TimerEngine *engine);
+void            timer_engine_set_advance     (TimerEngine *engine, GTimeSpan advance);
+
+void            timer_engine_ref_tick        (TimerEngine *engine);
+void            timer_engine_unref_tick      (TimerEngine *engine);
+
+void            timer_engine_attach          (TimerEngine *engine, GObject *owner);
+void            timer_engine_detach          (TimerEngine *engine, GObject *owner);
+TimerEngine    *timer_engine_from_object     (GObject *owner);
+
+G_END_DECLS
+
+#endif /* TIMER_ENGINE_H */
@@ -0,0 +1,273 @@
+/*
+ * timer-expiry.c
+ * What happens when the timer expires.
+ * The expiry runs as a pipeline:
+ *   1. for ExpiryAction=suspend or poweroff, a "delay" inhibitor lock is
+ *      taken from logind (Inhibit) and the suspend/power off is requested
+ *      (Suspend/PowerOff); logind then waits for the lock to be released
+ *      (at most its InhibitDelayMaxSec) before going ahead,
+ *   2. the stages added with timer_expiry_add_stage() run in order, each one
+ *      calling timer_expiry_stage_done() when it has completed,
+ *   3. the finish function runs, normally making totem exit.
+ * The lock is not released explicitly once the finish function ran: it is
+ * released when the process exits, i.e. after totem itself has saved its
+ * state.  Should logind be unavailable the pipeline carries on without it
+ * (totem still exits).
+ * Any service owning TIMER_LOGIND_NAME on the bus given by
+ * DBUS_SYSTEM_BUS_ADDRESS and implementing Inhibit, Suspend and PowerOff can
+ * stand in for logind.
+ *
+ *   Copyright (C) 2013 Christopher A. Doyle
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License along
+ *   with this program; if not, write to the Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "config.h"
+
+#include <unistd.h>
+#include <gio/gunixfdlist.h>
+
+#include "timer-expiry.h"
+#include "timer-logind.h"
+
+/* A stage of the pipeline. */
+typedef struct {
+  const gchar          *name;
+  TimerExpiryStageFunc  func;
+  gpointer              user_data;
+} TimerExpiryStageType;
+
+struct _TimerExpiry {
+  TimerExpiryActionType  action;
+  TimerExpiryFunc        finish;
+  gpointer               user_data;
+  GArray                *stages;      /* of TimerExpiryStageType, in order */
+  guint                  next_stage;  /* index of the stage to run next */
+  gboolean               running;     /* true once timer_expiry_run() started the pipeline */
+  gboolean               finished;    /* true once the finish function ran */
+  GCancellable          *cancellable; /* for the pending logind calls */
+  GDBusConnection       *connection;  /* system bus, NULL unless a system action is requested */
+  gint                   inhibit_fd;  /* delay lock taken from logind, -1 if none */
+};
+
+
+static void
+run_next_stage(TimerExpiry *expiry) {
+  TimerExpiryStageType *stage;
+
+  if (expiry->next_stage < expiry->stages->len) {
+    stage = &g_array_index(expiry->stages, TimerExpiryStageType, expiry->next_stage++);
+    g_debug("Timer: expiry stage %s", stage->name);
+    stage->func(expiry, stage->user_data);
+    return;
+  }
+
+  expiry->finished = TRUE;
+  expiry->finish(expiry->user_data); /* may free expiry */
+}
+
+
+/* Returns TRUE if error (if any) is the cancellation by timer_expiry_free(), i.e. expiry is gone. */
+static gboolean
+report_error(GError *error, const gchar *what) {
+  gboolean cancelled;
+
+  if (!error) {
+    return FALSE;
+  }
+  cancelled = g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+  if (!cancelled) {
+    g_warning("Timer: %s: %s", what, error->message);
+  }
+  g_error_free(error);
+  return cancelled;
+}
+
+
+static void
+on_action_requested(GObject *source, GAsyncResult *result, gpointer user_data) {
+  GVariant *reply;
+  GError   *error = NULL;
+
+  reply = g_dbus_connection_call_finish(G_DBUS_CONNECTION(source), result, &error);
+  if (report_error(error, "could not suspend/power off the machine")) {
+    return;
+  }
+  if (reply) {
+    g_variant_unref(reply);
+  }
+  run_next_stage(user_data);
+}
+
+
+static void
+on_inhibited(GObject *source, GAsyncResult *result, gpointer user_data) {
+  TimerExpiry *expiry;
+  GVariant    *reply;
+  GUnixFDList *fd_list = NULL;
+  GError      *error   = NULL;
+  gint32       index;
+
+  reply = g_dbus_connection_call_with_unix_fd_list_finish(G_DBUS_CONNECTION(source), &fd_list, result, &error);
+  if (report_error(error, "could not take an inhibitor lock")) {
+    return;
+  }
+  expiry = user_data;
+
+  if (reply) {
+    g_variant_get(reply, "(h)", &index);
+    expiry->inhibit_fd = fd_list ? g_unix_fd_list_get(fd_list, index, NULL) : -1;
+    g_variant_unref(reply);
+  }
+  g_clear_object(&fd_list);
+
+  /* with the lock held (if any), logind waits for the remaining stages before going ahead */
+  g_dbus_connection_call(expiry->connection,
+                         TIMER_LOGIND_NAME,
+                         TIMER_LOGIND_PATH,
+                         TIMER_LOGIND_INTERFACE,
+                         (expiry->action == TIMER_EXPIRY_ACTION_SUSPEND) ? "Suspend" : "PowerOff",
+                         g_variant_new("(b)", FALSE), /* not interactive */
+                         NULL,
+                         G_DBUS_CALL_FLAGS_NONE,
+                         -1,
+                         expiry->cancellable,
+                         on_action_requested,
+                         expiry);
+}
+
+
+static void
+on_bus_get(GObject *source, GAsyncResult *result, gpointer user_data) {
+  TimerExpiry     *expiry;
+  GDBusConnection *connection;
+  GError          *error = NULL;
+
+  connection = g_bus_get_finish(result, &error);
+  if (report_error(error, "could not connect to the system bus")) {
+    return;
+  }
+  expiry = user_data;
+
+  if (!connection) {
+    run_next_stage(expiry);
+    return;
+  }
+  expiry->connection = connection;
+
+  g_dbus_connection_call_with_unix_fd_list(connection,
+                                           TIMER_LOGIND_NAME,
+                                           TIMER_LOGIND_PATH,
+                                           TIMER_LOGIND_INTERFACE,
+                                           "Inhibit",
+                                           g_variant_new("(ssss)",
+                                                         (expiry->action == TIMER_EXPIRY_ACTION_SUSPEND) ? "sleep" : "shutdown",
+                                                         "Totem",
+                                                         "The sleep timer is finishing",
+                                                         "delay"),
+                                           G_VARIANT_TYPE("(h)"),
+                                           G_DBUS_CALL_FLAGS_NONE,
+                                           -1,
+                                           NULL,
+                                           expiry->cancellable,
+                                           on_inhibited,
+                                           expiry);
+}
+
+
+/* Create the expiry pipeline, configured by settings.  finish is called once every stage has completed. */
+TimerExpiry *
+timer_expiry_new(const TimerSettings *settings, TimerExpiryFunc finish, gpointer user_data) {
+  TimerExpiry *expiry = g_new0(TimerExpiry, 1);
+
+  expiry->action      = settings->expiry_action;
+  expiry->finish      = finish;
+  expiry->user_data   = user_data;
+  expiry->stages      = g_array_new(FALSE, FALSE, sizeof(TimerExpiryStageType));
+  expiry->cancellable = g_cancellable_new();
+  expiry->inhibit_fd  = -1;
+
+  return expiry;
+}
+
+
+void
+timer_expiry_free(TimerExpiry *expiry) {
+  /* the callbacks of cancelled calls still run, but don't touch expiry */
+  g_cancellable_cancel(expiry->cancellable);
+  g_object_unref(expiry->cancellable);
+
+  /* once finished, the lock is left to the exit of the process (see above) */
+  if ((expiry->inhibit_fd >= 0) && !expiry->finished) {
+    close(expiry->inhibit_fd);
+  }
+  g_clear_object(&expiry->connection);
+  g_array_free(expiry->stages, TRUE);
+  g_free(expiry);
+}
+
+
+/* Apply changed settings.  They don't affect a pipeline already running. */
+void
+timer_expiry_configure(TimerExpiry *expiry, const TimerSettings *settings) {
+  if (!expiry->running) {
+    expiry->action = settings->expiry_action;
+  }
+}
+
+
+/* Append a stage to the pipeline.  name is only used for debugging and must be a static string. */
+void
+timer_expiry_add_stage(TimerExpiry *expiry, const gchar *name, TimerExpiryStageFunc func, gpointer user_data) {
+  TimerExpiryStageType stage;
+
+  stage.name      = name;
+  stage.func      = func;
+  stage.user_data = user_data;
+  g_array_append_val(expiry->stages, stage);
+}
+
+
+/* Start the pipeline.  Called when the timer expired; further calls are ignored. */
+void
+timer_expiry_run(TimerExpiry *expiry) {
+  timer_expiry_run_action(expiry, expiry->action);
+}
+
+
+/* Start the pipeline with action rather than the configured one, e.g. a plain exit that isn't the expiry
+   of the timer.  Further calls (and calls to timer_expiry_run()) are ignored. */
+void
+timer_expiry_run_action(TimerExpiry *expiry, TimerExpiryActionType action) {
+  if (expiry->running) {
+    return;
+  }
+  expiry->running    = TRUE;
+  expiry->action     = action;
+  expiry->next_stage = 0;
+
+  if (expiry->action == TIMER_EXPIRY_ACTION_EXIT) {
+    run_next_stage(expiry);
+  } else {
+    g_bus_get(G_BUS_TYPE_SYSTEM, expiry->cancellable, on_bus_get, expiry);
+  }
+}
+
+
+/* Called by a stage once it has completed. */
+void
+timer_expiry_stage_done(TimerExpiry *expiry) {
+  run_next_stage(expiry);
+}
@@ -0,0 +1,47 @@
+/*
+ * timer-expiry.h
+ * What happens when the timer expires: a pipeline of stages ending in the
+ * exit of totem, optionally suspending or powering off the machine.
+ *
+ *   Copyright (C) 2013 Christopher A. Doyle
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License along
+ *   with this program; if not, write to the Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef TIMER_EXPIRY_H
+#define TIMER_EXPIRY_H
+
+#include <gio/gio.h>
+
+#include "timer-settings.h"
+
+typedef struct _TimerExpiry TimerExpiry;
+
+/* Called once every stage has completed, normally makes totem exit. */
+typedef void (*TimerExpiryFunc)(gpointer user_data);
+
+/* A stage of the pipeline.  It must call timer_expiry_stage_done() once it has completed,
+   either before returning or later from the main loop. */
+typedef void (*TimerExpiryStageFunc)(TimerExpiry *expiry, gpointer user_data);
+
+TimerExpiry *timer_expiry_new       (const TimerSettings *settings, TimerExpiryFunc finish, gpointer user_data);
+void         timer_expiry_free      (TimerExpiry *expiry);
+void         timer_expiry_configure (TimerExpiry *expiry, const TimerSettings *settings);
+void         timer_expiry_add_stage (TimerExpiry *expiry, const gchar *name, TimerExpiryStageFunc func, gpointer user_data);
+void         timer_expiry_run       (TimerExpiry *expiry);
+void         timer_expiry_run_action(TimerExpiry *expiry, TimerExpiryActionType action);
+void         timer_expiry_stage_done(TimerExpiry *expiry);
+
+#endif /* TIMER_EXPIRY_H */
@@ -0,0 +1,145 @@
+/*
+ * timer-idle.c
+ * Idle exit: expiry once totem has sat stopped or paused, without user
+ * activity (key presses, clicks, scrolling or pointer motion in the main
+ * window), for [Timer] IdleExit minutes, whether or not the timer runs.
+ * There is no polling: a single timeout runs while totem doesn't play, and
+ * user activity only records its time.  When the timeout fires early (there
+ * was activity since it was scheduled) it is re-armed for the rest of the
+ * period, so a burst of activity costs no more than one wakeup.
+ *
+ *   Copyright (C) 2013 Christopher A. Doyle
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License along
+ *   with this program; if not, write to the Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "config.h"
+
+#include "timer-idle.h"
+
+struct _TimerIdle {
+  TotemObject   *totem;
+  GtkWidget     *window;        /* main window of totem, whose input is the user activity */
+  GTimeSpan      period;        /* idle time before the expiry, 0 to disable */
+  gint64         last_activity; /* monotonic time of the last user activity or stop of the playback */
+  guint          timeout_id;    /* timeout source checking for the end of the period, 0 if none */
+  TimerIdleFunc  func;
+  gpointer       user_data;
+};
+
+static gboolean on_timeout(TimerIdle *idle);
+
+
+static void
+schedule(TimerIdle *idle, GTimeSpan delay) {
+  if (idle->timeout_id) {
+    g_source_remove(idle->timeout_id);
+  }
+  /* the period is in minutes, a coarse timeout will do */
+  idle->timeout_id = g_timeout_add_seconds((delay + G_TIME_SPAN_SECOND - 1) / G_TIME_SPAN_SECOND,
+                                           (GSourceFunc) on_timeout, idle);
+}
+
+
+static void
+unschedule(TimerIdle *idle) {
+  if (idle->timeout_id) {
+    g_source_remove(idle->timeout_id);
+    idle->timeout_id = 0;
+  }
+}
+
+
+static gboolean
+on_timeout(TimerIdle *idle) {
+  GTimeSpan left = idle->last_activity + idle->period - g_get_monotonic_time();
+
+  idle->timeout_id = 0;
+  if (left > 0) {
+    schedule(idle, left); /* there was activity meanwhile */
+    return G_SOURCE_REMOVE;
+  }
+
+  g_debug("Timer: idle for %" G_GINT64_FORMAT " minutes, expiring", idle->period / G_TIME_SPAN_MINUTE);
+  idle->func(idle->user_data);
+  return G_SOURCE_REMOVE;
+}
+
+
+static gboolean
+on_activity(TimerIdle *idle) {
+  idle->last_activity = g_get_monotonic_time();
+  return FALSE; /* let totem handle the event */
+}
+
+
+/* Runs the timeout only while totem doesn't play. */
+static void
+on_playing_changed(TimerIdle *idle) {
+  idle->last_activity = g_get_monotonic_time();
+  if ((idle->period == 0) || totem_is_playing(idle->totem)) {
+    unschedule(idle);
+  } else {
+    schedule(idle, idle->period);
+  }
+}
+
+
+/* Watch totem for idleness, calling func once it was idle for settings->idle_exit minutes. */
+TimerIdle *
+timer_idle_new(const TimerSettings *settings, TotemObject *totem, TimerIdleFunc func, gpointer user_data) {
+  TimerIdle *idle = g_new0(TimerIdle, 1);
+
+  idle->totem     = totem;
+  idle->window    = GTK_WIDGET(totem_get_main_window(totem));
+  idle->period    = (GTimeSpan) settings->idle_exit * G_TIME_SPAN_MINUTE;
+  idle->func      = func;
+  idle->user_data = user_data;
+
+  g_signal_connect_swapped(totem, "notify::playing", G_CALLBACK(on_playing_changed), idle);
+  g_signal_connect_swapped(idle->window, "key-press-event",     G_CALLBACK(on_activity), idle);
+  g_signal_connect_swapped(idle->window, "button-press-event",  G_CALLBACK(on_activity), idle);
+  g_signal_connect_swapped(idle->window, "scroll-event",        G_CALLBACK(on_activity), idle);
+  g_signal_connect_swapped(idle->window, "motion-notify-event", G_CALLBACK(on_activity), idle);
+  on_playing_changed(idle);
+
+  return idle;
+}
+
+
+void
+timer_idle_free(TimerIdle *idle) {
+  g_signal_handlers_disconnect_by_data(idle->totem,  idle);
+  g_signal_handlers_disconnect_by_data(idle->window, idle);
+  unschedule(idle);
+  g_free(idle);
+}
+
+
+/* Apply changed settings.  The new period counts from the last activity. */
+void
+timer_idle_configure(TimerIdle *idle, const TimerSettings *settings) {
+  GTimeSpan period = (GTimeSpan) settings->idle_exit * G_TIME_SPAN_MINUTE;
+
+  if (period == idle->period) {
+    return;
+  }
+  idle->period = period;
+  if ((period == 0) || totem_is_playing(idle->totem)) {
+    unschedule(idle);
+  } else {
+    schedule(idle, MAX(0, idle->last_activity + period - g_get_monotonic_time()));
+  }
+}
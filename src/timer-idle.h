@@ -0,0 +1,39 @@
+/*
+ * timer-idle.h
+ * Idle exit: expiry once totem has sat stopped or paused, without user
+ * activity, for [Timer] IdleExit minutes.
+ *
+ *   Copyright (C) 2013 Christopher A. Doyle
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License along
+ *   with this program; if not, write to the Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef TIMER_IDLE_H
+#define TIMER_IDLE_H
+
+#include <totem.h>
+
+#include "timer-settings.h"
+
+typedef struct _TimerIdle TimerIdle;
+
+/* Called when totem has been idle for the configured period. */
+typedef void (*TimerIdleFunc)(gpointer user_data);
+
+TimerIdle *timer_idle_new      (const TimerSettings *settings, TotemObject *totem, TimerIdleFunc func, gpointer user_data);
+void       timer_idle_free     (TimerIdle *idle);
+void       timer_idle_configure(TimerIdle *idle, const TimerSettings *settings);
+
+#endif /* TIMER_IDLE_H */
@@ -0,0 +1,125 @@
+/*
+ * timer-latency.c
+ * Estimate of the exit latency: the time from the expiry of the timer to the
+ * exit of the totem process, which is when the user sees playback stop.
+ * Each expiry that ends in an exit gives a sample, measured by an atexit()
+ * handler, and the estimate is a moving average of the samples of this
+ * machine, kept in $XDG_DATA_HOME/totem-plugin-timer/latency, e.g.
+ *   [Latency]
+ *   Estimate=850000
+ *   Samples=12
+ * (microseconds).  With [Timer] CompensateExitLatency the plugin makes the
+ * engine expire that much before the deadline (TimerEngine:advance), so that
+ * totem is gone at the configured time.  The estimate is reported as the
+ * exit-latency-us metric.
+ *
+ *   Copyright (C) 2013 Christopher A. Doyle
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License along
+ *   with this program; if not, write to the Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <glib/gstdio.h>
+
+#include "timer-latency.h"
+#include "timer-metrics.h"
+#include "timer-settings.h"
+
+/* The plugin module is never unloaded (see impl_activate()), so the atexit() handler stays valid. */
+static gint64 expiredAt = 0; /* monotonic time of the last expiry, 0 if none */
+
+
+static gchar *
+get_path(void) {
+  return g_build_filename(g_get_user_data_dir(), TIMER_SETTINGS_DIR, TIMER_LATENCY_FILE, NULL);
+}
+
+
+/* Read the stored estimate and its number of samples, 0 and 0 if there is none. */
+static void
+read_estimate(GTimeSpan *estimate, gint *samples) {
+  GKeyFile *key_file = g_key_file_new();
+  gchar    *path     = get_path();
+
+  *estimate = 0;
+  *samples  = 0;
+  if (g_key_file_load_from_file(key_file, path, G_KEY_FILE_NONE, NULL)) {
+    *estimate = CLAMP(g_key_file_get_int64(key_file, "Latency", "Estimate", NULL), 0, TIMER_LATENCY_MAX);
+    *samples  = MAX(0, g_key_file_get_integer(key_file, "Latency", "Samples", NULL));
+  }
+  g_key_file_free(key_file);
+  g_free(path);
+}
+
+
+/* Runs at the exit of the process, after an expiry: fold the latency into the estimate. */
+static void
+save_sample(void) {
+  GTimeSpan  latency = g_get_monotonic_time() - expiredAt;
+  GTimeSpan  estimate;
+  gint       samples;
+  GKeyFile  *key_file;
+  gchar     *contents;
+  gchar     *path;
+  gchar     *dir;
+
+  if ((latency < 0) || (latency > TIMER_LATENCY_MAX)) {
+    return;
+  }
+
+  read_estimate(&estimate, &samples);
+  estimate = samples ? estimate + (latency - estimate) / TIMER_LATENCY_WEIGHT : latency;
+
+  key_file = g_key_file_new();
+  g_key_file_set_int64  (key_file, "Latency", "Estimate", estimate);
+  g_key_file_set_integer(key_file, "Latency", "Samples",  samples + 1);
+  contents = g_key_file_to_data(key_file, NULL, NULL);
+  g_key_file_free(key_file);
+
+  dir  = g_build_filename(g_get_user_data_dir(), TIMER_SETTINGS_DIR, NULL);
+  path = get_path();
+  g_mkdir_with_parents(dir, 0700);
+  g_file_set_contents(path, contents, -1, NULL); /* nothing to report to, totem is exiting */
+  g_free(path);
+  g_free(dir);
+  g_free(contents);
+}
+
+
+/* Returns the estimated exit latency of this machine (in microseconds), 0 if it wasn't measured yet. */
+GTimeSpan
+timer_latency_get_estimate(void) {
+  GTimeSpan estimate;
+  gint      samples;
+
+  read_estimate(&estimate, &samples);
+  timer_metrics_set("exit-latency-us", estimate);
+  return estimate;
+}
+
+
+/* Called when the expiry starts: the latency is measured up to the exit of the process. */
+void
+timer_latency_expired(void) {
+  static gboolean registered = FALSE;
+
+  expiredAt = g_get_monotonic_time();
+  if (!registered) {
+    atexit(save_sample);
+    registered = TRUE;
+  }
+}
@@ -0,0 +1,34 @@
+/*
+ * timer-latency.h
+ * Estimate of the time totem takes to exit once the timer expired.
+ *
+ *   Copyright (C) 2013 Christopher A. Doyle
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License along
+ *   with this program; if not, write to the Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef TIMER_LATENCY_H
+#define TIMER_LATENCY_H
+
+#include <glib.h>
+
+#define TIMER_LATENCY_FILE   "latency"                /* in $XDG_DATA_HOME/TIMER_SETTINGS_DIR */
+#define TIMER_LATENCY_MAX    (30 * G_TIME_SPAN_SECOND) /* longer samples are ignored (e.g. totem hung) */
+#define TIMER_LATENCY_WEIGHT (4)                       /* a new sample moves the estimate by 1/TIMER_LATENCY_WEIGHT */
+
+GTimeSpan timer_latency_get_estimate(void);
+void      timer_latency_expired     (void);
+
+#endif /* TIMER_LATENCY_H */
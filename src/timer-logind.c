@@ -0,0 +1,189 @@
+/*
+ * timer-logind.c
+ * Suspend/resume awareness of the timer.
+ * The engine waits on CLOCK_MONOTONIC, which stops while the machine is
+ * suspended, so on its own a timer armed for 30 minutes before a 2 hour
+ * suspend would still have its full remaining time after resume.  Instead,
+ * logind's PrepareForSleep(b) signal on the system bus is watched:
+ *   - PrepareForSleep(true) records the wall-clock deadline and the remaining
+ *     time of the running timer,
+ *   - PrepareForSleep(false) (resume) re-arms a single deadline according to
+ *     the [Timer] Suspend setting (TimerSuspendPolicyType):
+ *       count   suspend time counts; a deadline that passed during suspend
+ *               leaves TIMER_MIN minute(s), so totem doesn't vanish the
+ *               moment the machine wakes up,
+ *       freeze  the countdown is paused while suspended,
+ *       expire  suspend time counts; a deadline that passed during suspend
+ *               expires immediately (default).
+ *     A timer armed for a wall-clock time (TIMER_ENGINE_MODE_CLOCK) is never
+ *     frozen.  The engine itself re-anchors such a deadline on resume (see
+ *     timer-engine.c), which is all the other engines (schedule, dwell...)
+ *     get: they aren't watched here.
+ * Only the signal is used, so any service owning TIMER_LOGIND_NAME on the bus
+ * given by DBUS_SYSTEM_BUS_ADDRESS can stand in for logind, e.g.
+ *   gdbus emit --system --object-path /org/freedesktop/login1 \
+ *     --signal org.freedesktop.login1.Manager.PrepareForSleep true
+ *
+ *   Copyright (C) 2013 Christopher A. Doyle
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License along
+ *   with this program; if not, write to the Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "config.h"
+
+#include "timer-logind.h"
+
+struct _TimerLogind {
+  TimerEngine            *engine;          /* controlled by this object */
+  TimerSuspendPolicyType  policy;          /* applied on resume */
+  GCancellable           *cancellable;     /* for the pending g_bus_get() */
+  GDBusConnection        *connection;      /* system bus, NULL until acquired */
+  guint                   subscription_id; /* PrepareForSleep subscription, 0 if none */
+  gboolean                sleeping;        /* true between PrepareForSleep(true) and PrepareForSleep(false) */
+  gint64                  deadline;        /* wall-clock deadline of the timer when going to sleep, 0 if none */
+  GTimeSpan               remaining;       /* remaining time of the timer when going to sleep */
+  TimerEngineMode         mode;            /* mode of the timer when going to sleep */
+};
+
+
+static void
+prepare_for_sleep(TimerLogind *logind) {
+  logind->sleeping  = TRUE;
+  logind->deadline  = timer_engine_get_deadline(logind->engine);
+  logind->remaining = timer_engine_get_remaining(logind->engine);
+  logind->mode      = timer_engine_get_mode(logind->engine);
+}
+
+
+static void
+resumed(TimerLogind *logind) {
+  gint64 now = g_get_real_time();
+
+  if (!logind->sleeping) {
+    return;
+  }
+  logind->sleeping = FALSE;
+
+  if ((logind->deadline == 0) || !timer_engine_is_armed(logind->engine)) {
+    return; /* no timer was running, or it was cancelled/expired meanwhile */
+  }
+  if (timer_engine_get_deadline(logind->engine) != logind->deadline) {
+    return; /* re-armed meanwhile (e.g. by another instance), the new deadline stands */
+  }
+
+  if ((logind->policy == TIMER_SUSPEND_POLICY_FREEZE) && (logind->mode == TIMER_ENGINE_MODE_COUNTDOWN)) {
+    timer_engine_command(logind->engine, TIMER_COMMAND_ARM, MAX(logind->remaining, 1));
+  } else if (now < logind->deadline) {
+    if (logind->mode == TIMER_ENGINE_MODE_CLOCK) {
+      timer_engine_command(logind->engine, TIMER_COMMAND_ARM_AT, logind->deadline);
+    } else {
+      timer_engine_command(logind->engine, TIMER_COMMAND_ARM, logind->deadline - now);
+    }
+  } else if (logind->policy == TIMER_SUSPEND_POLICY_COUNT) {
+    timer_engine_command(logind->engine, TIMER_COMMAND_ARM, TIMER_MIN * G_TIME_SPAN_MINUTE);
+  } else {
+    timer_engine_command(logind->engine, TIMER_COMMAND_EXPIRE, 0);
+  }
+}
+
+
+static void
+on_prepare_for_sleep(GDBusConnection *connection,
+                     const gchar     *sender_name,
+                     const gchar     *object_path,
+                     const gchar     *interface_name,
+                     const gchar     *signal_name,
+                     GVariant        *parameters,
+                     gpointer         user_data) {
+  TimerLogind *logind = user_data;
+  gboolean     start;
+
+  if (!g_variant_is_of_type(parameters, G_VARIANT_TYPE("(b)"))) {
+    return;
+  }
+  g_variant_get(parameters, "(b)", &start);
+
+  if (start) {
+    prepare_for_sleep(logind);
+  } else {
+    resumed(logind);
+  }
+}
+
+
+static void
+on_bus_get(GObject *source, GAsyncResult *result, gpointer user_data) {
+  TimerLogind     *logind;
+  GDBusConnection *connection;
+  GError          *error = NULL;
+
+  connection = g_bus_get_finish(result, &error);
+  if (!connection) {
+    if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+      g_warning("Timer: could not connect to the system bus, suspend is not handled: %s", error->message);
+    }
+    g_error_free(error);
+    return;
+  }
+
+  logind                  = user_data;
+  logind->connection      = connection;
+  logind->subscription_id = g_dbus_connection_signal_subscribe(connection,
+                                                               TIMER_LOGIND_NAME,
+                                                               TIMER_LOGIND_INTERFACE,
+                                                               "PrepareForSleep",
+                                                               TIMER_LOGIND_PATH,
+                                                               NULL,
+                                                               G_DBUS_SIGNAL_FLAGS_NONE,
+                                                               on_prepare_for_sleep,
+                                                               logind,
+                                                               NULL);
+}
+
+
+/* Watch for suspend/resume of the machine, applying the configured suspend policy to engine. */
+TimerLogind *
+timer_logind_watch(const TimerSettings *settings, TimerEngine *engine) {
+  TimerLogind *logind = g_new0(TimerLogind, 1);
+
+  logind->engine      = engine;
+  logind->policy      = settings->suspend_policy;
+  logind->cancellable = g_cancellable_new();
+
+  g_bus_get(G_BUS_TYPE_SYSTEM, logind->cancellable, on_bus_get, logind);
+
+  return logind;
+}
+
+
+void
+timer_logind_unwatch(TimerLogind *logind) {
+  /* on_bus_get() still runs for a cancelled g_bus_get(), but only touches logind on success */
+  g_cancellable_cancel(logind->cancellable);
+  g_object_unref(logind->cancellable);
+
+  if (logind->subscription_id) {
+    g_dbus_connection_signal_unsubscribe(logind->connection, logind->subscription_id);
+  }
+  g_clear_object(&logind->connection);
+  g_free(logind);
+}
+
+
+/* Apply changed settings.  A suspend in progress is resumed with the new policy. */
+void
+timer_logind_configure(TimerLogind *logind, const TimerSettings *settings) {
+  logind->policy = settings->suspend_policy;
+}
@@ -0,0 +1,39 @@
+/*
+ * timer-logind.h
+ * Suspend/resume awareness of the timer, through logind's PrepareForSleep signal.
+ *
+ *   Copyright (C) 2013 Christopher A. Doyle
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License along
+ *   with this program; if not, write to the Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef TIMER_LOGIND_H
+#define TIMER_LOGIND_H
+
+#include <gio/gio.h>
+
+#include "timer-settings.h"
+
+#define TIMER_LOGIND_NAME      "org.freedesktop.login1"
+#define TIMER_LOGIND_PATH      "/org/freedesktop/login1"
+#define TIMER_LOGIND_INTERFACE "org.freedesktop.login1.Manager"
+
+typedef struct _TimerLogind TimerLogind;
+
+TimerLogind *timer_logind_watch    (const TimerSettings *settings, TimerEngine *engine);
+void         timer_logind_unwatch  (TimerLogind *logind);
+void         timer_logind_configure(TimerLogind *logind, const TimerSettings *settings);
+
+#endif /* TIMER_LOGIND_H */
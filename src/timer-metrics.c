@@ -0,0 +1,153 @@
+/*
+ * timer-metrics.c
+ * Named counters and timings of the plugin, e.g.
+ *   activate-critical-us   time spent in impl_activate()
+ *   activate-deferred-us   time spent in the deferred part of the activation
+ *   menu-open-us           time the Timer sub-menu last took from being opened to drawn
+ * Timings are in microseconds and carry a "-us" suffix.  Besides numbers,
+ * a module can register a function building a structured metric on demand
+ * (e.g. qos-buckets, see timer-qos.c).  Metrics live for
+ * the whole process (they survive re-activation of the plugin) and may be
+ * updated from any thread.
+ *
+ *   Copyright (C) 2013 Christopher A. Doyle
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License along
+ *   with this program; if not, write to the Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "config.h"
+
+#include "timer-metrics.h"
+
+/* A structured metric, see timer_metrics_register(). */
+typedef struct {
+  TimerMetricsFunc func;
+  gpointer         user_data;
+} TimerMetricsSourceType;
+
+static GMutex      metricsMutex;
+static GHashTable *metrics = NULL; /* name (static string) -> gint64 */
+static GHashTable *sources = NULL; /* name (static string) -> GSList of TimerMetricsSourceType, newest first */
+
+
+/* Returns the slot of name, creating it (0) if needed.  Called with metricsMutex held. */
+static gint64 *
+lookup(const gchar *name) {
+  gint64 *value;
+
+  if (!metrics) {
+    metrics = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, g_free);
+  }
+  value = g_hash_table_lookup(metrics, name);
+  if (!value) {
+    value = g_new0(gint64, 1);
+    g_hash_table_insert(metrics, (gpointer) name, value);
+  }
+  return value;
+}
+
+
+/* Set a metric.  name must be a static string. */
+void
+timer_metrics_set(const gchar *name, gint64 value) {
+  g_mutex_lock(&metricsMutex);
+  *lookup(name) = value;
+  g_mutex_unlock(&metricsMutex);
+}
+
+
+/* Add value to a metric (a counter).  name must be a static string. */
+void
+timer_metrics_add(const gchar *name, gint64 value) {
+  g_mutex_lock(&metricsMutex);
+  *lookup(name) += value;
+  g_mutex_unlock(&metricsMutex);
+}
+
+
+/* Returns every metric as a floating a{sv}: int64 values, and the values of the structured metrics. */
+GVariant *
+timer_metrics_to_variant(void) {
+  GVariantBuilder builder;
+  GHashTableIter  iter;
+  gpointer        name;
+  gpointer        value;
+
+  g_variant_builder_init(&builder, G_VARIANT_TYPE_VARDICT);
+
+  g_mutex_lock(&metricsMutex);
+  if (metrics) {
+    g_hash_table_iter_init(&iter, metrics);
+    while (g_hash_table_iter_next(&iter, &name, &value)) {
+      g_variant_builder_add(&builder, "{sv}", (const gchar *) name, g_variant_new_int64(*(gint64 *) value));
+    }
+  }
+  if (sources) {
+    g_hash_table_iter_init(&iter, sources);
+    while (g_hash_table_iter_next(&iter, &name, &value)) {
+      TimerMetricsSourceType *source = ((GSList *) value)->data;
+
+      g_variant_builder_add(&builder, "{sv}", (const gchar *) name, source->func(source->user_data));
+    }
+  }
+  g_mutex_unlock(&metricsMutex);
+
+  return g_variant_builder_end(&builder);
+}
+
+
+/* Register a structured metric, whose value func builds when the metrics are read.  name must be a static
+   string.  func is called with the metrics locked, so it must not update metrics itself.  Several plugin
+   instances may register the same name: the latest registration still in place reports the metric. */
+void
+timer_metrics_register(const gchar *name, TimerMetricsFunc func, gpointer user_data) {
+  TimerMetricsSourceType *source = g_new0(TimerMetricsSourceType, 1);
+
+  source->func      = func;
+  source->user_data = user_data;
+
+  g_mutex_lock(&metricsMutex);
+  if (!sources) {
+    sources = g_hash_table_new(g_str_hash, g_str_equal);
+  }
+  g_hash_table_insert(sources, (gpointer) name, g_slist_prepend(g_hash_table_lookup(sources, name), source));
+  g_mutex_unlock(&metricsMutex);
+}
+
+
+/* Undo the timer_metrics_register() of name with func and user_data, leaving other registrations of name. */
+void
+timer_metrics_unregister(const gchar *name, TimerMetricsFunc func, gpointer user_data) {
+  TimerMetricsSourceType *source;
+  GSList                 *list;
+  GSList                 *l;
+
+  g_mutex_lock(&metricsMutex);
+  list = sources ? g_hash_table_lookup(sources, name) : NULL;
+  for (l=list; l; l=l->next) {
+    source = l->data;
+    if ((source->func == func) && (source->user_data == user_data)) {
+      list = g_slist_delete_link(list, l);
+      g_free(source);
+      break;
+    }
+  }
+  if (list) {
+    g_hash_table_insert(sources, (gpointer) name, list);
+  } else if (sources) {
+    g_hash_table_remove(sources, name);
+  }
+  g_mutex_unlock(&metricsMutex);
+}
@@ -0,0 +1,37 @@
+/*
+ * timer-metrics.h
+ * Named counters and timings of the plugin, reported over D-Bus (GetMetrics).
+ *
+ *   Copyright (C) 2013 Christopher A. Doyle
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License along
+ *   with this program; if not, write to the Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef TIMER_METRICS_H
+#define TIMER_METRICS_H
+
+#include <glib.h>
+
+void      timer_metrics_set       (const gchar *name, gint64 value);
+void      timer_metrics_add       (const gchar *name, gint64 value);
+GVariant *timer_metrics_to_variant(void);
+
+/* Returns the (floating) value of a metric that isn't a plain number, built when the metrics are read. */
+typedef GVariant *(*TimerMetricsFunc)(gpointer user_data);
+
+void      timer_metrics_register  (const gchar *name, TimerMetricsFunc func, gpointer user_data);
+void      timer_metrics_unregister(const gchar *name, TimerMetricsFunc func, gpointer user_data);
+
+#endif /* TIMER_METRICS_H */
@@ -0,0 +1,293 @@
+/*
+ * timer-netclock.c
+ * Deadlines referred to a clock shared over the network ([NetClock] group
+ * of the settings), so that several totem instances, e.g. those of a video
+ * wall, expire or switch at the same instant.
+ * One instance is the provider: it serves its wall clock with a
+ * GstNetTimeProvider.  The others are clients: a GstNetClientClock follows
+ * the clock of the provider.  Once the shared clock is synced (checked every
+ * second until it is, right away for the provider), the engines of the
+ * timer and of the schedule read it as their wall-clock time: deadlines
+ * given with ArmAt (D-Bus) or by the schedule, and the reported deadlines,
+ * are then times of the provider's wall clock.  When the clock changes, a
+ * timer armed for a wall-clock time is re-armed for that time of the new
+ * clock, a countdown keeps its deadline.
+ * Metrics:
+ *   netclock-offset-us    shared clock minus the local wall clock
+ *   netclock-lateness-us  time of the shared clock at which the timer
+ *                         last expired, minus its deadline
+ * The lateness is measured in shared time, so the differences between the
+ * latenesses of the participants of a synchronized expiry are their skews.
+ *
+ *   Copyright (C) 2013 Christopher A. Doyle
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License along
+ *   with this program; if not, write to the Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "config.h"
+
+#include <gst/gst.h>
+#include <gst/net/net.h>
+
+#include "timer-clock.h"
+#include "timer-metrics.h"
+#include "timer-netclock.h"
+
+struct _TimerNetClock {
+  TimerNetClockRoleType  role;
+  gchar                 *address;
+  gint                   port;
+  GstClock              *clock;     /* shared clock, NULL if none */
+  GstNetTimeProvider    *provider;  /* serving clock, NULL unless the provider */
+  gboolean               synced;    /* true once the engines read clock */
+  guint                  sync_id;   /* timeout source waiting for clock to sync, 0 if none */
+  GSList                *engines;   /* reading clock once synced */
+  TimerEngine           *engine;    /* timer whose expiries are measured */
+  gint64                 deadline;  /* last deadline of engine, in shared time */
+};
+
+
+static gint64
+shared_monotonic_time(gpointer user_data) {
+  return g_get_monotonic_time();
+}
+
+
+static gint64
+shared_real_time(gpointer user_data) {
+  TimerNetClock *netclock = user_data;
+
+  return GST_TIME_AS_USECONDS(gst_clock_get_time(netclock->clock));
+}
+
+
+static gboolean
+shared_wait_until(GCond *cond, GMutex *mutex, gint64 end_time, gpointer user_data) {
+  return g_cond_wait_until(cond, mutex, end_time);
+}
+
+/* Deadlines are still waited for in monotonic time, the shared clock only gives the wall-clock time. */
+static const TimerClockType sharedClock = {
+  shared_monotonic_time,
+  shared_real_time,
+  shared_wait_until
+};
+
+
+/* Take ownership of a new clock, floating or not depending on the version of GStreamer. */
+static GstClock *
+sink_clock(GstClock *clock) {
+  if (clock && g_object_is_floating(clock)) {
+    gst_object_ref_sink(clock);
+  }
+  return clock;
+}
+
+
+/* Replace the clock of engine, re-arming a timer armed for a wall-clock time. */
+static void
+set_clock(TimerEngine *engine, const TimerClockType *clock, gpointer user_data) {
+  gint64 deadline = 0;
+
+  if (timer_engine_is_armed(engine) && (timer_engine_get_mode(engine) == TIMER_ENGINE_MODE_CLOCK)) {
+    deadline = timer_engine_get_deadline(engine);
+  }
+  timer_engine_set_clock(engine, clock, user_data);
+  if (deadline) {
+    timer_engine_command(engine, TIMER_COMMAND_ARM_AT, deadline);
+  }
+}
+
+
+static void
+attach_engines(TimerNetClock *netclock) {
+  GSList *l;
+
+  netclock->synced = TRUE;
+  for (l=netclock->engines; l; l=l->next) {
+    set_clock(l->data, &sharedClock, netclock);
+  }
+  g_debug("Timer: deadlines refer to the shared clock (offset %" G_GINT64_FORMAT " us)",
+          shared_real_time(netclock) - g_get_real_time());
+}
+
+
+static gboolean
+on_sync_check(TimerNetClock *netclock) {
+  if (!gst_clock_is_synced(netclock->clock)) {
+    return G_SOURCE_CONTINUE;
+  }
+  netclock->sync_id = 0;
+  attach_engines(netclock);
+  return G_SOURCE_REMOVE;
+}
+
+
+static void
+start(TimerNetClock *netclock) {
+  switch (netclock->role) {
+  case TIMER_NETCLOCK_ROLE_PROVIDER:
+    netclock->clock    = sink_clock(g_object_new(GST_TYPE_SYSTEM_CLOCK, "clock-type", GST_CLOCK_TYPE_REALTIME, NULL));
+    netclock->provider = gst_net_time_provider_new(netclock->clock, netclock->address, netclock->port);
+    if (!netclock->provider) {
+      g_warning("Timer: could not serve the shared clock on port %d", netclock->port);
+      gst_object_unref(netclock->clock);
+      netclock->clock = NULL;
+      return;
+    }
+    attach_engines(netclock);
+    break;
+  case TIMER_NETCLOCK_ROLE_CLIENT:
+    if (!netclock->address) {
+      g_warning("Timer: [NetClock] Role=client needs an Address, ignored");
+      return;
+    }
+    netclock->clock = sink_clock(gst_net_client_clock_new("totem-timer", netclock->address, netclock->port, 0));
+    if (!netclock->clock) {
+      g_warning("Timer: could not follow the shared clock of %s:%d", netclock->address, netclock->port);
+      return;
+    }
+    netclock->sync_id = g_timeout_add_seconds(1, (GSourceFunc) on_sync_check, netclock);
+    break;
+  default:
+    break;
+  }
+}
+
+
+static void
+stop(TimerNetClock *netclock) {
+  GSList *l;
+
+  if (netclock->sync_id) {
+    g_source_remove(netclock->sync_id);
+    netclock->sync_id = 0;
+  }
+  if (netclock->synced) {
+    for (l=netclock->engines; l; l=l->next) {
+      set_clock(l->data, NULL, NULL); /* no longer reads clock once it returned */
+    }
+    netclock->synced = FALSE;
+  }
+  g_clear_object(&netclock->provider);
+  if (netclock->clock) {
+    gst_object_unref(netclock->clock);
+    netclock->clock = NULL;
+  }
+}
+
+
+static void
+on_deadline_changed(TimerEngine *engine, GParamSpec *pspec, TimerNetClock *netclock) {
+  gint64 deadline = timer_engine_get_deadline(engine);
+
+  if (deadline) {
+    netclock->deadline = deadline; /* cleared before "expired" is emitted */
+  }
+}
+
+
+static void
+on_engine_expired(TimerEngine *engine, TimerNetClock *netclock) {
+  gint64 lateness;
+
+  if (!netclock->synced || !netclock->deadline) {
+    return;
+  }
+  lateness = timer_engine_get_time(engine) - netclock->deadline;
+  timer_metrics_set("netclock-lateness-us", lateness);
+  g_debug("Timer: expired %" G_GINT64_FORMAT " us after the deadline, in shared time", lateness);
+}
+
+
+static GVariant *
+offset_to_variant(TimerNetClock *netclock) {
+  gint64 offset = 0;
+
+  if (netclock->clock) {
+    offset = shared_real_time(netclock) - g_get_real_time();
+  }
+  return g_variant_new_int64(offset);
+}
+
+
+/* Refer the deadlines of engine (the timer) to the clock configured by settings, if any. */
+TimerNetClock *
+timer_netclock_new(const TimerSettings *settings, TimerEngine *engine) {
+  TimerNetClock *netclock = g_new0(TimerNetClock, 1);
+
+  netclock->role    = settings->netclock_role;
+  netclock->address = g_strdup(settings->netclock_address);
+  netclock->port    = settings->netclock_port;
+  netclock->engine  = engine;
+  netclock->engines = g_slist_prepend(NULL, engine);
+
+  g_signal_connect(engine, "notify::deadline", G_CALLBACK(on_deadline_changed), netclock);
+  g_signal_connect(engine, "expired",          G_CALLBACK(on_engine_expired),   netclock);
+  timer_metrics_register("netclock-offset-us", (TimerMetricsFunc) offset_to_variant, netclock);
+  start(netclock);
+
+  return netclock;
+}
+
+
+/* Restores the system clock of the engines. */
+void
+timer_netclock_free(TimerNetClock *netclock) {
+  timer_metrics_unregister("netclock-offset-us", (TimerMetricsFunc) offset_to_variant, netclock);
+  stop(netclock);
+  g_signal_handlers_disconnect_by_data(netclock->engine, netclock);
+  g_slist_free(netclock->engines);
+  g_free(netclock->address);
+  g_free(netclock);
+}
+
+
+/* Apply changed settings.  A different clock replaces the current one. */
+void
+timer_netclock_configure(TimerNetClock *netclock, const TimerSettings *settings) {
+  if ((netclock->role == settings->netclock_role) &&
+      (g_strcmp0(netclock->address, settings->netclock_address) == 0) &&
+      (netclock->port == settings->netclock_port)) {
+    return;
+  }
+  stop(netclock);
+  g_free(netclock->address);
+  netclock->role    = settings->netclock_role;
+  netclock->address = g_strdup(settings->netclock_address);
+  netclock->port    = settings->netclock_port;
+  start(netclock);
+}
+
+
+/* Refer the deadlines of another engine (e.g. of the schedule) to the shared clock.  engine must outlive
+   netclock, or be removed with timer_netclock_remove_engine() first. */
+void
+timer_netclock_add_engine(TimerNetClock *netclock, TimerEngine *engine) {
+  netclock->engines = g_slist_prepend(netclock->engines, engine);
+  if (netclock->synced) {
+    set_clock(engine, &sharedClock, netclock);
+  }
+}
+
+
+/* Give engine, added with timer_netclock_add_engine(), its system clock back. */
+void
+timer_netclock_remove_engine(TimerNetClock *netclock, TimerEngine *engine) {
+  netclock->engines = g_slist_remove(netclock->engines, engine);
+  if (netclock->synced) {
+    set_clock(engine, NULL, NULL);
+  }
+}
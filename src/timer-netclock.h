@@ -0,0 +1,36 @@
+/*
+ * timer-netclock.h
+ * Deadlines referred to a clock shared over the network.
+ *
+ *   Copyright (C) 2013 Christopher A. Doyle
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License along
+ *   with this program; if not, write to the Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef TIMER_NETCLOCK_H
+#define TIMER_NETCLOCK_H
+
+#include "timer-engine.h"
+#include "timer-settings.h"
+
+typedef struct _TimerNetClock TimerNetClock;
+
+TimerNetClock *timer_netclock_new          (const TimerSettings *settings, TimerEngine *engine);
+void           timer_netclock_free         (TimerNetClock *netclock);
+void           timer_netclock_configure    (TimerNetClock *netclock, const TimerSettings *settings);
+void           timer_netclock_add_engine   (TimerNetClock *netclock, TimerEngine *engine);
+void           timer_netclock_remove_engine(TimerNetClock *netclock, TimerEngine *engine);
+
+#endif /* TIMER_NETCLOCK_H */
@@ -0,0 +1,104 @@
+/*
+ * timer-prestop.c
+ * Stop of the playback shortly before the deadline ([Timer] PreStop).
+ * Stopping totem shuts its GStreamer pipeline down, releasing the decoders
+ * and the video sink, which is the slowest part of totem_action_exit().
+ * Done ahead of time, it leaves little to do at the deadline, so the exit
+ * is quick and lands on the deadline.
+ * The stop is a main loop timeout, rescheduled whenever the deadline
+ * changes; it only fires while the timer runs.  A timer re-armed after the
+ * stop doesn't restart the playback.
+ *
+ *   Copyright (C) 2013 Christopher A. Doyle
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License along
+ *   with this program; if not, write to the Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "config.h"
+
+#include "timer-prestop.h"
+
+struct _TimerPrestop {
+  TimerEngine *engine;
+  TotemObject *totem;
+  GTimeSpan    lead;     /* how long before the deadline the playback is stopped, 0 to disable */
+  guint        stop_id;  /* timeout source stopping the playback, 0 if none */
+};
+
+
+static gboolean
+on_stop(TimerPrestop *prestop) {
+  prestop->stop_id = 0;
+  g_debug("Timer: stopping the playback %" G_GINT64_FORMAT " ms before the deadline",
+          timer_engine_get_remaining(prestop->engine) / G_TIME_SPAN_MILLISECOND);
+  totem_action_stop(prestop->totem);
+  return G_SOURCE_REMOVE;
+}
+
+
+/* (Re)schedule the stop for the current deadline. */
+static void
+reschedule(TimerPrestop *prestop) {
+  GTimeSpan delay;
+
+  if (prestop->stop_id) {
+    g_source_remove(prestop->stop_id);
+    prestop->stop_id = 0;
+  }
+  if ((prestop->lead == 0) || !timer_engine_is_armed(prestop->engine)) {
+    return;
+  }
+
+  delay = MAX(0, timer_engine_get_remaining(prestop->engine) - prestop->lead);
+  prestop->stop_id = g_timeout_add_full(G_PRIORITY_HIGH, delay / G_TIME_SPAN_MILLISECOND,
+                                        (GSourceFunc) on_stop, prestop, NULL);
+}
+
+
+/* Stop the playback of totem settings->prestop before the deadline of engine. */
+TimerPrestop *
+timer_prestop_new(const TimerSettings *settings, TimerEngine *engine, TotemObject *totem) {
+  TimerPrestop *prestop = g_new0(TimerPrestop, 1);
+
+  prestop->engine = engine;
+  prestop->totem  = totem;
+  prestop->lead   = settings->prestop;
+
+  g_signal_connect_swapped(engine, "notify::armed",    G_CALLBACK(reschedule), prestop);
+  g_signal_connect_swapped(engine, "notify::deadline", G_CALLBACK(reschedule), prestop);
+  reschedule(prestop);
+
+  return prestop;
+}
+
+
+void
+timer_prestop_free(TimerPrestop *prestop) {
+  g_signal_handlers_disconnect_by_data(prestop->engine, prestop);
+  if (prestop->stop_id) {
+    g_source_remove(prestop->stop_id);
+  }
+  g_free(prestop);
+}
+
+
+/* Apply changed settings. */
+void
+timer_prestop_configure(TimerPrestop *prestop, const TimerSettings *settings) {
+  if (prestop->lead != settings->prestop) {
+    prestop->lead = settings->prestop;
+    reschedule(prestop);
+  }
+}
@@ -0,0 +1,37 @@
+/*
+ * timer-prestop.h
+ * Stop of the playback shortly before the deadline, so that the exit upon
+ * expiry doesn't have to tear down the media pipeline.
+ *
+ *   Copyright (C) 2013 Christopher A. Doyle
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License along
+ *   with this program; if not, write to the Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef TIMER_PRESTOP_H
+#define TIMER_PRESTOP_H
+
+#include <totem.h>
+
+#include "timer-engine.h"
+#include "timer-settings.h"
+
+typedef struct _TimerPrestop TimerPrestop;
+
+TimerPrestop *timer_prestop_new      (const TimerSettings *settings, TimerEngine *engine, TotemObject *totem);
+void          timer_prestop_free     (TimerPrestop *prestop);
+void          timer_prestop_configure(TimerPrestop *prestop, const TimerSettings *settings);
+
+#endif /* TIMER_PRESTOP_H */
@@ -0,0 +1,297 @@
+/*
+ * timer-qos.c
+ * Dropped-frame and jitter statistics of totem's playback.
+ * totem doesn't expose its pipeline to plugins, so the plugin finds it
+ * through an emission hook on GstBin::element-added: the first time a
+ * top-level playbin of the process gets an element (it does for each new
+ * item), its bus is watched for QoS messages ("message::qos", on the signal
+ * watch totem already runs on the main loop).  Other pipelines, e.g. those
+ * of the GstDiscoverer prerolling scheduled media (see timer-schedule.c),
+ * are left alone.
+ * Each QoS message of a video sink (GST_FORMAT_BUFFERS) is folded, in
+ * constant time, into the bucket of the current TIMER_QOS_INTERVAL of a ring
+ * of TIMER_QOS_BUCKETS buckets: frames rendered and dropped (differences of
+ * the cumulative counts of the message, per element), number of messages,
+ * and sum and maximum of the absolute jitter.  The ring is reported as the
+ * qos-buckets metric, an array of
+ *   (start, rendered, dropped, messages, mean jitter, max jitter)
+ * from the oldest interval to the current one, start being wall-clock
+ * microseconds since the epoch and the jitters microseconds.  The totals are
+ * the qos-rendered and qos-dropped metrics.
+ * The ASYNC_DONE messages of the pipeline, posted once its sinks prerolled
+ * (the video sink showing the first frame of a new item), are passed on to
+ * the prerolled function, for the latency of scheduled switches (see
+ * timer-schedule.c).
+ *
+ *   Copyright (C) 2013 Christopher A. Doyle
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License along
+ *   with this program; if not, write to the Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "config.h"
+
+#include <string.h>
+#include <gst/gst.h>
+
+#include "timer-metrics.h"
+#include "timer-qos.h"
+
+typedef struct {
+  gint64  epoch;      /* number of the interval (monotonic time / TIMER_QOS_INTERVAL), -1 if unused */
+  gint64  start;      /* wall-clock time the interval started */
+  guint64 rendered;
+  guint64 dropped;
+  guint64 messages;
+  gint64  jitter_sum; /* absolute jitter, microseconds */
+  gint64  jitter_max;
+} TimerQosBucketType;
+
+/* Cumulative counts of the last message of an element. */
+typedef struct {
+  guint64 processed;
+  guint64 dropped;
+} TimerQosCountsType;
+
+struct _TimerQos {
+  guint               signal_id;  /* of GstBin::element-added */
+  gulong              hook_id;
+  GMutex              mutex;      /* protects pending, pending_id and pipeline, used by the hook in any thread */
+  GstElement         *pending;    /* pipeline found by the hook, to be watched from the main loop */
+  guint               pending_id; /* idle source watching it */
+  GstElement         *pipeline;   /* watched pipeline (reference held), NULL if none yet */
+  GstBus             *bus;        /* its bus */
+  GHashTable         *counts;     /* message source (GstObject *, reference held) -> TimerQosCountsType */
+  TimerQosBucketType  buckets[TIMER_QOS_BUCKETS];
+  TimerQosFunc        prerolled_func;
+  gpointer            prerolled_data;
+};
+
+
+static void
+on_qos(GstBus *bus, GstMessage *message, TimerQos *qos) {
+  TimerQosBucketType *bucket;
+  TimerQosCountsType *counts;
+  GstFormat           format;
+  guint64             processed;
+  guint64             dropped;
+  guint64             new_processed;
+  guint64             new_dropped;
+  gint64              jitter;
+  gint64              epoch;
+
+  gst_message_parse_qos_stats(message, &format, &processed, &dropped);
+  if (format != GST_FORMAT_BUFFERS) {
+    return; /* not counting frames, e.g. an audio sink */
+  }
+  gst_message_parse_qos_values(message, &jitter, NULL, NULL);
+  jitter = ABS(jitter) / 1000; /* to microseconds */
+
+  counts = g_hash_table_lookup(qos->counts, GST_MESSAGE_SRC(message));
+  if (!counts) {
+    counts = g_new0(TimerQosCountsType, 1);
+    g_hash_table_insert(qos->counts, gst_object_ref(GST_MESSAGE_SRC(message)), counts);
+  }
+  /* the counts restart from 0 at each state change of the element */
+  new_processed     = (processed >= counts->processed) ? processed - counts->processed : processed;
+  new_dropped       = (dropped   >= counts->dropped)   ? dropped   - counts->dropped   : dropped;
+  counts->processed = processed;
+  counts->dropped   = dropped;
+
+  epoch  = g_get_monotonic_time() / TIMER_QOS_INTERVAL;
+  bucket = &qos->buckets[epoch % TIMER_QOS_BUCKETS];
+  if (bucket->epoch != epoch) {
+    memset(bucket, 0, sizeof(*bucket));
+    bucket->epoch = epoch;
+    bucket->start = g_get_real_time();
+  }
+  bucket->rendered   += new_processed;
+  bucket->dropped    += new_dropped;
+  bucket->messages   += 1;
+  bucket->jitter_sum += jitter;
+  bucket->jitter_max  = MAX(bucket->jitter_max, jitter);
+
+  timer_metrics_add("qos-rendered", new_processed);
+  timer_metrics_add("qos-dropped",  new_dropped);
+}
+
+
+static void
+on_async_done(GstBus *bus, GstMessage *message, TimerQos *qos) {
+  if (GST_MESSAGE_SRC(message) == GST_OBJECT(qos->pipeline)) {
+    qos->prerolled_func(qos->prerolled_data);
+  }
+}
+
+
+static void
+unwatch(TimerQos *qos) {
+  GstElement *pipeline;
+
+  if (qos->bus) {
+    g_signal_handlers_disconnect_by_data(qos->bus, qos);
+    gst_bus_remove_signal_watch(qos->bus);
+    gst_object_unref(qos->bus);
+    qos->bus = NULL;
+  }
+
+  g_mutex_lock(&qos->mutex);
+  pipeline      = qos->pipeline;
+  qos->pipeline = NULL;
+  g_mutex_unlock(&qos->mutex);
+  if (pipeline) {
+    gst_object_unref(pipeline);
+  }
+  g_hash_table_remove_all(qos->counts);
+}
+
+
+/* Watch the pipeline found by the hook.  Runs on the main loop. */
+static gboolean
+watch_pending(TimerQos *qos) {
+  GstElement *pipeline;
+
+  g_mutex_lock(&qos->mutex);
+  pipeline        = qos->pending;
+  qos->pending    = NULL;
+  qos->pending_id = 0;
+  g_mutex_unlock(&qos->mutex);
+
+  if (pipeline && (pipeline != qos->pipeline)) {
+    unwatch(qos);
+    g_mutex_lock(&qos->mutex);
+    qos->pipeline = pipeline; /* takes the reference of pending */
+    g_mutex_unlock(&qos->mutex);
+    qos->bus = gst_element_get_bus(pipeline);
+    gst_bus_add_signal_watch(qos->bus);
+    g_signal_connect(qos->bus, "message::qos",        G_CALLBACK(on_qos),        qos);
+    g_signal_connect(qos->bus, "message::async-done", G_CALLBACK(on_async_done), qos);
+    g_debug("Timer: watching the QoS messages of %s", GST_OBJECT_NAME(pipeline));
+  } else if (pipeline) {
+    gst_object_unref(pipeline);
+  }
+  return G_SOURCE_REMOVE;
+}
+
+
+/* Returns TRUE if bin is a playbin, as totem plays with. */
+static gboolean
+is_playbin(GstObject *bin) {
+  GstElementFactory *factory = gst_element_get_factory(GST_ELEMENT(bin));
+  const gchar       *name    = factory ? gst_plugin_feature_get_name(GST_PLUGIN_FEATURE(factory)) : NULL;
+
+  return (g_strcmp0(name, "playbin") == 0) || (g_strcmp0(name, "playbin2") == 0);
+}
+
+
+/* Emission hook of GstBin::element-added, in whatever thread added the element. */
+static gboolean
+on_element_added(GSignalInvocationHint *hint, guint n_params, const GValue *params, gpointer user_data) {
+  TimerQos *qos = user_data;
+  GstObject *bin = g_value_get_object(&params[0]);
+
+  if (!GST_IS_PIPELINE(bin) || GST_OBJECT_PARENT(bin) || !is_playbin(bin)) {
+    return TRUE; /* only totem's pipeline: a top-level playbin */
+  }
+
+  g_mutex_lock(&qos->mutex);
+  if (((GstElement *) bin != qos->pipeline) && ((GstElement *) bin != qos->pending)) {
+    if (qos->pending) {
+      gst_object_unref(qos->pending);
+    }
+    qos->pending = gst_object_ref(bin);
+    if (!qos->pending_id) {
+      qos->pending_id = g_idle_add((GSourceFunc) watch_pending, qos);
+    }
+  }
+  g_mutex_unlock(&qos->mutex);
+
+  return TRUE; /* stay installed */
+}
+
+
+static GVariant *
+buckets_to_variant(TimerQos *qos) {
+  GVariantBuilder     builder;
+  TimerQosBucketType *bucket;
+  gint64              epoch = g_get_monotonic_time() / TIMER_QOS_INTERVAL;
+  gint64              e;
+
+  g_variant_builder_init(&builder, G_VARIANT_TYPE("a(xxxxxx)"));
+  for (e=epoch - TIMER_QOS_BUCKETS + 1; e<=epoch; e++) {
+    if (e < 0) {
+      continue;
+    }
+    bucket = &qos->buckets[e % TIMER_QOS_BUCKETS];
+    if (bucket->epoch != e) {
+      continue; /* no message in that interval */
+    }
+    g_variant_builder_add(&builder, "(xxxxxx)",
+                          bucket->start,
+                          (gint64) bucket->rendered,
+                          (gint64) bucket->dropped,
+                          (gint64) bucket->messages,
+                          bucket->jitter_sum / (gint64) bucket->messages,
+                          bucket->jitter_max);
+  }
+  return g_variant_builder_end(&builder);
+}
+
+
+/* Start collecting the QoS statistics of totem's pipeline, calling prerolled_func each time it prerolled. */
+TimerQos *
+timer_qos_new(TimerQosFunc prerolled_func, gpointer user_data) {
+  TimerQos *qos = g_new0(TimerQos, 1);
+  gpointer  bin_class;
+  guint     i;
+
+  qos->prerolled_func = prerolled_func;
+  qos->prerolled_data = user_data;
+
+  for (i=0; i<TIMER_QOS_BUCKETS; i++) {
+    qos->buckets[i].epoch = -1;
+  }
+  g_mutex_init(&qos->mutex);
+  qos->counts = g_hash_table_new_full(g_direct_hash, g_direct_equal, gst_object_unref, g_free);
+
+  bin_class      = g_type_class_ref(GST_TYPE_BIN); /* the signal must exist to be hooked */
+  qos->signal_id = g_signal_lookup("element-added", GST_TYPE_BIN);
+  qos->hook_id   = g_signal_add_emission_hook(qos->signal_id, 0, on_element_added, qos, NULL);
+  g_type_class_unref(bin_class);
+
+  timer_metrics_register("qos-buckets", (TimerMetricsFunc) buckets_to_variant, qos);
+
+  return qos;
+}
+
+
+void
+timer_qos_free(TimerQos *qos) {
+  timer_metrics_unregister("qos-buckets", (TimerMetricsFunc) buckets_to_variant, qos);
+  g_signal_remove_emission_hook(qos->signal_id, qos->hook_id);
+
+  g_mutex_lock(&qos->mutex);
+  if (qos->pending_id) {
+    g_source_remove(qos->pending_id);
+  }
+  if (qos->pending) {
+    gst_object_unref(qos->pending);
+  }
+  g_mutex_unlock(&qos->mutex);
+
+  unwatch(qos);
+  g_hash_table_destroy(qos->counts);
+  g_mutex_clear(&qos->mutex);
+  g_free(qos);
+}
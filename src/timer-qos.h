@@ -0,0 +1,39 @@
+/*
+ * timer-qos.h
+ * Dropped-frame and jitter statistics of totem's playback, from the QoS
+ * messages of its GStreamer pipeline.
+ *
+ *   Copyright (C) 2013 Christopher A. Doyle
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License along
+ *   with this program; if not, write to the Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef TIMER_QOS_H
+#define TIMER_QOS_H
+
+#include <glib.h>
+
+#define TIMER_QOS_BUCKETS  (60)                     /* number of intervals kept */
+#define TIMER_QOS_INTERVAL (10 * G_TIME_SPAN_SECOND) /* length of an interval */
+
+typedef struct _TimerQos TimerQos;
+
+/* Called when totem's pipeline prerolled (async-done), e.g. with the first frame of a new item shown. */
+typedef void (*TimerQosFunc)(gpointer user_data);
+
+TimerQos *timer_qos_new (TimerQosFunc prerolled_func, gpointer user_data);
+void      timer_qos_free(TimerQos *qos);
+
+#endif /* TIMER_QOS_H */
@@ -0,0 +1,296 @@
+/*
+ * timer-schedule.c
+ * Switches of the playlist at set times of day ([Schedule] group of the
+ * settings), e.g. "at 18:00 play the evening playlist": at the time of an
+ * entry its URI (a media or a playlist file) replaces totem's playlist and
+ * starts playing.
+ * The next switch is kept by a TimerEngine of its own, armed at its
+ * wall-clock time (so that it follows wall-clock steps and resumes, see
+ * timer-engine.c), whose
+ * warning TIMER_SCHEDULE_PREROLL ahead prerolls the media in the background
+ * with a GstDiscoverer: the file or stream gets opened, its demuxer and
+ * decoders loaded and its first buffers decoded, so that the caches are warm
+ * and totem's own pipeline gets to its first frame quickly at the switch.
+ * A GstDiscoverer can't open a playlist, so the URI is first resolved with
+ * totem-pl-parser (as totem does at the switch): the first item of a
+ * playlist is prerolled, a URI that isn't one is prerolled as such.
+ * totem having a single pipeline, the switch itself still stops the current
+ * item before the new one starts.
+ * The switch latency, from the scheduled time to the new item playing (its
+ * first frame prerolled on the video sink: the ASYNC_DONE of totem's
+ * pipeline, found by timer-qos.c), is reported in the
+ * schedule-latency-us metric (last switch) and the switches are counted in
+ * schedule-switches; the time the preroll took is schedule-preroll-us.
+ *
+ *   Copyright (C) 2013 Christopher A. Doyle
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License along
+ *   with this program; if not, write to the Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "config.h"
+
+#include <gst/pbutils/pbutils.h>
+#include <totem-pl-parser.h>
+
+#include "timer-engine.h"
+#include "timer-metrics.h"
+#include "timer-schedule.h"
+
+struct _TimerSchedule {
+  TotemObject   *totem;
+  TimerEngine   *engine;     /* keeping the time of the next switch */
+  GArray        *entries;    /* copy of the [Schedule] entries, of TimerScheduleEntryType */
+  gchar         *next_uri;   /* URI of the next switch, NULL if none */
+  gint64         next_time;  /* wall-clock time of the next switch, on the engine's clock (see timer_engine_get_time()) */
+  gint64         last_time;  /* wall-clock time of the last switch, 0 if none */
+  gboolean       switching;  /* true from a switch until the new item prerolled */
+  TotemPlParser *parser;      /* resolving next_uri to the media to preroll, NULL if not running */
+  GCancellable  *cancellable; /* of the parsing */
+  gchar         *preroll_uri; /* first item of the playlist next_uri, NULL if none (yet) */
+  GstDiscoverer *discoverer;  /* prerolling the media, NULL if not running */
+  gint64         preroll_started;
+};
+
+
+/* Returns the wall-clock time of the first occurrence of entry after from. */
+static gint64
+next_occurrence(const TimerScheduleEntryType *entry, gint64 from) {
+  GDateTime *now  = g_date_time_new_from_unix_local(from / G_USEC_PER_SEC);
+  GDateTime *day  = g_date_time_new_local(g_date_time_get_year(now),
+                                          g_date_time_get_month(now),
+                                          g_date_time_get_day_of_month(now),
+                                          entry->hour, entry->minute, 0);
+  GDateTime *next;
+  gint64     time;
+
+  next = (g_date_time_to_unix(day) * G_USEC_PER_SEC > from) ? g_date_time_ref(day) : g_date_time_add_days(day, 1);
+  time = g_date_time_to_unix(next) * G_USEC_PER_SEC;
+
+  g_date_time_unref(next);
+  g_date_time_unref(day);
+  g_date_time_unref(now);
+  return time;
+}
+
+
+static void
+stop_preroll(TimerSchedule *schedule) {
+  if (schedule->parser) {
+    g_cancellable_cancel(schedule->cancellable);
+    g_clear_object(&schedule->cancellable);
+    g_signal_handlers_disconnect_by_data(schedule->parser, schedule);
+    g_clear_object(&schedule->parser);
+  }
+  g_clear_pointer(&schedule->preroll_uri, g_free);
+  if (schedule->discoverer) {
+    gst_discoverer_stop(schedule->discoverer);
+    g_signal_handlers_disconnect_by_data(schedule->discoverer, schedule);
+    g_object_unref(schedule->discoverer);
+    schedule->discoverer = NULL;
+  }
+}
+
+
+/* Arm the engine for the first entry after the last switch (and now), cancel it if there is none. */
+static void
+update(TimerSchedule *schedule) {
+  const TimerScheduleEntryType *entry;
+  gint64                        from = MAX(timer_engine_get_time(schedule->engine), schedule->last_time);
+  gint64                        time;
+  guint                         i;
+
+  stop_preroll(schedule);
+  g_clear_pointer(&schedule->next_uri, g_free);
+
+  for (i=0; i<schedule->entries->len; i++) {
+    entry = &g_array_index(schedule->entries, TimerScheduleEntryType, i);
+    time  = next_occurrence(entry, from);
+    if (!schedule->next_uri || (time < schedule->next_time)) {
+      g_free(schedule->next_uri);
+      schedule->next_uri  = g_strdup(entry->uri);
+      schedule->next_time = time;
+    }
+  }
+
+  if (schedule->next_uri) {
+    timer_engine_command(schedule->engine, TIMER_COMMAND_ARM_AT, schedule->next_time);
+  } else {
+    timer_engine_command(schedule->engine, TIMER_COMMAND_CANCEL, 0);
+  }
+}
+
+
+static void
+on_discovered(GstDiscoverer *discoverer, GstDiscovererInfo *info, GError *error, TimerSchedule *schedule) {
+  const gchar *uri = gst_discoverer_info_get_uri(info);
+
+  if (error) {
+    g_warning("Timer: could not preroll %s: %s", uri, error->message);
+    return;
+  }
+  timer_metrics_set("schedule-preroll-us", g_get_monotonic_time() - schedule->preroll_started);
+  g_debug("Timer: prerolled %s", uri);
+}
+
+
+static void
+discover(TimerSchedule *schedule, const gchar *uri) {
+  GError *error = NULL;
+
+  schedule->discoverer = gst_discoverer_new(TIMER_SCHEDULE_PREROLL * GST_USECOND, &error);
+  if (!schedule->discoverer) {
+    g_warning("Timer: could not preroll %s: %s", uri, error->message);
+    g_error_free(error);
+    return;
+  }
+  g_signal_connect(schedule->discoverer, "discovered", G_CALLBACK(on_discovered), schedule);
+  gst_discoverer_start(schedule->discoverer);
+  gst_discoverer_discover_uri_async(schedule->discoverer, uri);
+}
+
+
+/* Keep the first item of the playlist being parsed. */
+static void
+on_entry_parsed(TotemPlParser *parser, const gchar *uri, GHashTable *metadata, TimerSchedule *schedule) {
+  if (!schedule->preroll_uri) {
+    schedule->preroll_uri = g_strdup(uri);
+  }
+}
+
+
+/* next_uri was parsed: preroll the first item of the playlist, or next_uri itself if it isn't one. */
+static void
+on_parsed(TotemPlParser *parser, GAsyncResult *result, TimerSchedule *schedule) {
+  GError *error = NULL;
+
+  totem_pl_parser_parse_finish(parser, result, &error);
+  if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+    g_error_free(error);
+    return; /* stopped, schedule may be gone */
+  }
+  g_clear_error(&error); /* e.g. not a playlist */
+
+  discover(schedule, schedule->preroll_uri ? schedule->preroll_uri : schedule->next_uri);
+}
+
+
+/* Engine warning, TIMER_SCHEDULE_PREROLL before the switch. */
+static void
+on_engine_warning(TimerEngine *engine, TimerSchedule *schedule) {
+  stop_preroll(schedule);
+  schedule->preroll_started = g_get_monotonic_time();
+  schedule->parser          = totem_pl_parser_new();
+  schedule->cancellable     = g_cancellable_new();
+  g_signal_connect(schedule->parser, "entry-parsed", G_CALLBACK(on_entry_parsed), schedule);
+  totem_pl_parser_parse_async(schedule->parser, schedule->next_uri, FALSE, schedule->cancellable,
+                              (GAsyncReadyCallback) on_parsed, schedule);
+}
+
+
+static void
+on_engine_expired(TimerEngine *engine, TimerSchedule *schedule) {
+  g_debug("Timer: scheduled switch to %s", schedule->next_uri);
+  schedule->last_time = schedule->next_time;
+  schedule->switching = TRUE;
+  totem_action_remote(schedule->totem, TOTEM_REMOTE_COMMAND_REPLACE, schedule->next_uri);
+  update(schedule);
+}
+
+
+static void
+copy_entries(TimerSchedule *schedule, const TimerSettings *settings) {
+  TimerScheduleEntryType *entry;
+  TimerScheduleEntryType  copy;
+  guint                   i;
+
+  g_array_set_size(schedule->entries, 0);
+  for (i=0; i<settings->schedule->len; i++) {
+    entry       = &g_array_index(settings->schedule, TimerScheduleEntryType, i);
+    copy.hour   = entry->hour;
+    copy.minute = entry->minute;
+    copy.uri    = g_strdup(entry->uri);
+    g_array_append_val(schedule->entries, copy);
+  }
+}
+
+
+static void
+clear_entry(TimerScheduleEntryType *entry) {
+  g_free(entry->uri);
+}
+
+
+/* Switch the playlist of totem at the times configured by settings. */
+TimerSchedule *
+timer_schedule_new(const TimerSettings *settings, TotemObject *totem) {
+  TimerSchedule *schedule = g_new0(TimerSchedule, 1);
+
+  schedule->totem   = totem;
+  schedule->engine  = timer_engine_new();
+  schedule->entries = g_array_new(FALSE, FALSE, sizeof(TimerScheduleEntryType));
+  g_array_set_clear_func(schedule->entries, (GDestroyNotify) clear_entry);
+  copy_entries(schedule, settings);
+
+  timer_engine_set_slack(schedule->engine, settings->slack);
+  timer_engine_set_warning_time(schedule->engine, TIMER_SCHEDULE_PREROLL);
+  g_signal_connect(schedule->engine, "warning", G_CALLBACK(on_engine_warning), schedule);
+  g_signal_connect(schedule->engine, "expired", G_CALLBACK(on_engine_expired), schedule);
+  update(schedule);
+
+  return schedule;
+}
+
+
+void
+timer_schedule_free(TimerSchedule *schedule) {
+  stop_preroll(schedule);
+  g_signal_handlers_disconnect_by_data(schedule->engine, schedule);
+  g_object_unref(schedule->engine);
+  g_array_free(schedule->entries, TRUE);
+  g_free(schedule->next_uri);
+  g_free(schedule);
+}
+
+
+/* Apply changed settings.  The next switch is looked up again. */
+void
+timer_schedule_configure(TimerSchedule *schedule, const TimerSettings *settings) {
+  timer_engine_set_slack(schedule->engine, settings->slack);
+  copy_entries(schedule, settings);
+  update(schedule);
+}
+
+
+/* Returns the engine keeping the time of the switches, e.g. to refer it to a shared clock. */
+TimerEngine *
+timer_schedule_get_engine(TimerSchedule *schedule) {
+  return schedule->engine;
+}
+
+
+/* totem's pipeline prerolled: the new item of a switch shows its first frame. */
+void
+timer_schedule_prerolled(TimerSchedule *schedule) {
+  gint64 latency;
+
+  if (!schedule->switching) {
+    return; /* e.g. after a seek */
+  }
+  schedule->switching = FALSE;
+  latency             = timer_engine_get_time(schedule->engine) - schedule->last_time;
+  timer_metrics_set("schedule-latency-us", latency);
+  timer_metrics_add("schedule-switches", 1);
+  g_debug("Timer: scheduled switch showing its first frame after %" G_GINT64_FORMAT " us", latency);
+}
@@ -0,0 +1,39 @@
+/*
+ * timer-schedule.h
+ * Switches of the playlist at set times of day.
+ *
+ *   Copyright (C) 2013 Christopher A. Doyle
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License along
+ *   with this program; if not, write to the Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef TIMER_SCHEDULE_H
+#define TIMER_SCHEDULE_H
+
+#include <totem.h>
+
+#include "timer-settings.h"
+
+#define TIMER_SCHEDULE_PREROLL (10 * G_TIME_SPAN_SECOND) /* how long before a switch its media is prerolled */
+
+typedef struct _TimerSchedule TimerSchedule;
+
+TimerSchedule *timer_schedule_new       (const TimerSettings *settings, TotemObject *totem);
+void           timer_schedule_free      (TimerSchedule *schedule);
+void           timer_schedule_configure (TimerSchedule *schedule, const TimerSettings *settings);
+TimerEngine   *timer_schedule_get_engine(TimerSchedule *schedule);
+void           timer_schedule_prerolled (TimerSchedule *schedule);
+
+#endif /* TIMER_SCHEDULE_H */
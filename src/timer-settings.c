@@ -0,0 +1,502 @@
+/*
+ * timer-settings.c
+ * User configuration of the timer plugin.
+ * Example $XDG_CONFIG_HOME/totem-plugin-timer/timer.conf:
+ *   [Timer]
+ *   DefaultTimeout=60
+ *   ExtendTimeout=15
+ *   Shared=false
+ *   Suspend=expire
+ *   ExpiryAction=exit
+ *   Slack=0
+ *   CompensateExitLatency=false
+ *   PreStop=0
+ *   IdleExit=0
+ *
+ *   [Watchdog]
+ *   Budget=0
+ *   Recovery=reload
+ *
+ *   [Dwell]
+ *   file:///srv/signage/news/*=2
+ *   *.jpg=1
+ *
+ *   [Schedule]
+ *   08:00=file:///srv/signage/day.m3u
+ *   18:00=file:///srv/signage/evening.m3u
+ *
+ *   [NetClock]
+ *   Role=none
+ *   Address=192.168.1.10
+ *   Port=5637
+ *
+ *   [Signals]
+ *   SIGUSR1=cancel
+ *   SIGUSR2=extend
+ *   SIGHUP=rearm
+ * A missing file, group or key (or an invalid value) leaves the built-in default in place.
+ * Changes to the file are picked up while totem runs, see timer-config.c.
+ *
+ * The timer can also be armed at startup through the TOTEM_TIMER environment
+ * variable, holding either a duration in minutes ("90" or "90m") or a local
+ * wall-clock time ("23:30", the next occurrence of that time).
+ *
+ *   Copyright (C) 2013 Christopher A. Doyle
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License along
+ *   with this program; if not, write to the Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+
+#include "timer-settings.h"
+
+/* Key names in the [Signals] group, indexed by TIMER_SIGNAL_IDX_*. */
+static const gchar *signalKeys [TIMER_NUM_SIGNALS] = {
+  "SIGHUP",
+  "SIGUSR1",
+  "SIGUSR2"
+};
+
+/* Values accepted in the [Signals] group, indexed by TimerSignalActionType. */
+static const gchar *signalActionNames [] = {
+  "none",
+  "cancel",
+  "extend",
+  "rearm"
+};
+
+/* Values accepted for [Timer] Suspend, indexed by TimerSuspendPolicyType. */
+static const gchar *suspendPolicyNames [] = {
+  "count",
+  "freeze",
+  "expire"
+};
+
+/* Values accepted for [Watchdog] Recovery, indexed by TimerWatchdogRecoveryType. */
+static const gchar *watchdogRecoveryNames [] = {
+  "reload",
+  "skip",
+  "exit"
+};
+
+/* Values accepted for [NetClock] Role, indexed by TimerNetClockRoleType. */
+static const gchar *netClockRoleNames [] = {
+  "none",
+  "provider",
+  "client"
+};
+
+/* Values accepted for [Timer] ExpiryAction, indexed by TimerExpiryActionType. */
+static const gchar *expiryActionNames [] = {
+  "exit",
+  "suspend",
+  "poweroff"
+};
+
+
+/* Read a timeout (in minutes) from the key file, keeping *timeout if the key is missing or out of range. */
+static void
+read_timeout(GKeyFile *key_file, const gchar *group, const gchar *key, TimeType *timeout) {
+  GError *error = NULL;
+  gint    value;
+
+  value = g_key_file_get_integer(key_file, group, key, &error);
+  if (error) {
+    g_error_free(error);
+    return;
+  }
+  if ((value < TIMER_MIN) || (value > TIMER_MAX)) {
+    g_warning("Timer: [%s] %s=%d is outside of %d..%d, ignored", group, key, value, TIMER_MIN, TIMER_MAX);
+    return;
+  }
+  *timeout = (TimeType) value;
+}
+
+
+/* Like read_timeout(), 0 being accepted as well (disabled). */
+static void
+read_optional_timeout(GKeyFile *key_file, const gchar *group, const gchar *key, TimeType *timeout) {
+  GError *error = NULL;
+  gint    value;
+
+  value = g_key_file_get_integer(key_file, group, key, &error);
+  if (error) {
+    g_error_free(error);
+    return;
+  }
+  if (value == 0) {
+    *timeout = 0;
+    return;
+  }
+  read_timeout(key_file, group, key, timeout);
+}
+
+
+/* Read a duration in units (e.g. G_TIME_SPAN_MILLISECOND) from the key file into *value (in microseconds),
+   keeping *value if the key is missing or out of 0..max units. */
+static void
+read_duration(GKeyFile *key_file, const gchar *group, const gchar *key, GTimeSpan unit, gint max, GTimeSpan *value) {
+  GError *error = NULL;
+  gint    result;
+
+  result = g_key_file_get_integer(key_file, group, key, &error);
+  if (error) {
+    g_error_free(error);
+    return;
+  }
+  if ((result < 0) || (result > max)) {
+    g_warning("Timer: [%s] %s=%d is outside of 0..%d, ignored", group, key, result, max);
+    return;
+  }
+  *value = (GTimeSpan) result * unit;
+}
+
+
+static void
+read_boolean(GKeyFile *key_file, const gchar *group, const gchar *key, gboolean *value) {
+  GError   *error = NULL;
+  gboolean  result;
+
+  result = g_key_file_get_boolean(key_file, group, key, &error);
+  if (error) {
+    g_error_free(error);
+    return;
+  }
+  *value = result;
+}
+
+
+/* Read one of names[0..num_names-1] from the key file, keeping *choice (an index into names) if the key
+   is missing or holds an unknown value. */
+static void
+read_choice(GKeyFile *key_file, const gchar *group, const gchar *key,
+            const gchar **names, guint num_names, guint *choice) {
+  gchar *value;
+  guint  i;
+
+  value = g_key_file_get_string(key_file, group, key, NULL);
+  if (!value) {
+    return;
+  }
+  g_strstrip(value);
+
+  for (i=0; i<num_names; i++) {
+    if (g_ascii_strcasecmp(value, names[i]) == 0) {
+      *choice = i;
+      break;
+    }
+  }
+  if (i == num_names) {
+    g_warning("Timer: [%s] %s=%s is not a known value, ignored", group, key, value);
+  }
+  g_free(value);
+}
+
+
+static void
+read_signal_action(GKeyFile *key_file, const gchar *key, TimerSignalActionType *action) {
+  guint choice = *action;
+
+  read_choice(key_file, "Signals", key, signalActionNames, G_N_ELEMENTS(signalActionNames), &choice);
+  *action = (TimerSignalActionType) choice;
+}
+
+
+static void
+read_suspend_policy(GKeyFile *key_file, TimerSuspendPolicyType *policy) {
+  guint choice = *policy;
+
+  read_choice(key_file, "Timer", "Suspend", suspendPolicyNames, G_N_ELEMENTS(suspendPolicyNames), &choice);
+  *policy = (TimerSuspendPolicyType) choice;
+}
+
+
+static void
+read_expiry_action(GKeyFile *key_file, TimerExpiryActionType *action) {
+  guint choice = *action;
+
+  read_choice(key_file, "Timer", "ExpiryAction", expiryActionNames, G_N_ELEMENTS(expiryActionNames), &choice);
+  *action = (TimerExpiryActionType) choice;
+}
+
+
+static void
+read_watchdog_recovery(GKeyFile *key_file, TimerWatchdogRecoveryType *recovery) {
+  guint choice = *recovery;
+
+  read_choice(key_file, "Watchdog", "Recovery", watchdogRecoveryNames, G_N_ELEMENTS(watchdogRecoveryNames), &choice);
+  *recovery = (TimerWatchdogRecoveryType) choice;
+}
+
+
+static void
+read_netclock_role(GKeyFile *key_file, TimerNetClockRoleType *role) {
+  guint choice = *role;
+
+  read_choice(key_file, "NetClock", "Role", netClockRoleNames, G_N_ELEMENTS(netClockRoleNames), &choice);
+  *role = (TimerNetClockRoleType) choice;
+}
+
+
+static void
+read_port(GKeyFile *key_file, const gchar *group, const gchar *key, gint *port) {
+  GError *error = NULL;
+  gint    value;
+
+  value = g_key_file_get_integer(key_file, group, key, &error);
+  if (error) {
+    g_error_free(error);
+    return;
+  }
+  if ((value < 1) || (value > 65535)) {
+    g_warning("Timer: [%s] %s=%d is outside of 1..65535, ignored", group, key, value);
+    return;
+  }
+  *port = value;
+}
+
+
+/* Read the rules of the [Dwell] group, in the order of the file: each key is a glob matched against the
+   MRL of an item, its value the dwell time in minutes (0 for no limit). */
+static void
+read_dwell_rules(GKeyFile *key_file, GArray *rules) {
+  TimerDwellRuleType   rule;
+  GError              *error = NULL;
+  gchar              **keys;
+  gint                 minutes;
+  guint                i;
+
+  keys = g_key_file_get_keys(key_file, "Dwell", NULL, NULL);
+  if (!keys) {
+    return;
+  }
+  for (i=0; keys[i]; i++) {
+    minutes = g_key_file_get_integer(key_file, "Dwell", keys[i], &error);
+    if (error) {
+      g_warning("Timer: [Dwell] %s is not a number of minutes, ignored", keys[i]);
+      g_clear_error(&error);
+      continue;
+    }
+    if ((minutes < 0) || (minutes > TIMER_DWELL_MAX)) {
+      g_warning("Timer: [Dwell] %s=%d is outside of 0..%d, ignored", keys[i], minutes, TIMER_DWELL_MAX);
+      continue;
+    }
+    rule.pattern = g_strdup(keys[i]);
+    rule.dwell   = (GTimeSpan) minutes * G_TIME_SPAN_MINUTE;
+    g_array_append_val(rules, rule);
+  }
+  g_strfreev(keys);
+}
+
+
+static void
+clear_dwell_rule(TimerDwellRuleType *rule) {
+  g_free(rule->pattern);
+}
+
+
+/* Read the entries of the [Schedule] group: each key is a local time of day (HH:MM), its value the URI
+   switched to at that time. */
+static void
+read_schedule(GKeyFile *key_file, GArray *schedule) {
+  TimerScheduleEntryType   entry;
+  gchar                  **keys;
+  gchar                   *uri;
+  guint                    i;
+
+  keys = g_key_file_get_keys(key_file, "Schedule", NULL, NULL);
+  if (!keys) {
+    return;
+  }
+  for (i=0; keys[i]; i++) {
+    if ((2 != sscanf(keys[i], "%2u:%2u", &entry.hour, &entry.minute)) || (entry.hour > 23) || (entry.minute > 59)) {
+      g_warning("Timer: [Schedule] %s is not a time of day (HH:MM), ignored", keys[i]);
+      continue;
+    }
+    uri = g_key_file_get_string(key_file, "Schedule", keys[i], NULL);
+    if (!uri || !*g_strstrip(uri)) {
+      g_warning("Timer: [Schedule] %s has no URI, ignored", keys[i]);
+      g_free(uri);
+      continue;
+    }
+    entry.uri = uri;
+    g_array_append_val(schedule, entry);
+  }
+  g_strfreev(keys);
+}
+
+
+static void
+clear_schedule_entry(TimerScheduleEntryType *entry) {
+  g_free(entry->uri);
+}
+
+
+/* Returns the path of the settings file (to be freed). */
+gchar *
+timer_settings_get_path(void) {
+  return g_build_filename(g_get_user_config_dir(), TIMER_SETTINGS_DIR, TIMER_SETTINGS_FILE, NULL);
+}
+
+
+/* Parse the contents of a settings file, falling back to built-in defaults for anything not configured.
+   data may be NULL (no file). */
+TimerSettings *
+timer_settings_parse(const gchar *data, gsize length) {
+  TimerSettings *settings = g_new0(TimerSettings, 1);
+  GKeyFile      *key_file;
+  guint          i;
+
+  /* Built-in defaults. */
+  settings->default_timeout                          = TIMER_ADJ_DEFAULT;
+  settings->extend_timeout                           = TIMER_EXTEND_DEFAULT;
+  settings->shared                                   = FALSE;
+  settings->suspend_policy                           = TIMER_SUSPEND_POLICY_EXPIRE;
+  settings->expiry_action                            = TIMER_EXPIRY_ACTION_EXIT;
+  settings->slack                                    = 0;
+  settings->compensate_latency                       = FALSE;
+  settings->prestop                                  = 0;
+  settings->idle_exit                                = 0;
+  settings->watchdog_budget                          = 0;
+  settings->watchdog_recovery                        = TIMER_WATCHDOG_RECOVERY_RELOAD;
+  settings->dwell_rules                              = g_array_new(FALSE, FALSE, sizeof(TimerDwellRuleType));
+  settings->schedule                                 = g_array_new(FALSE, FALSE, sizeof(TimerScheduleEntryType));
+  settings->signal_actions[TIMER_SIGNAL_IDX_SIGHUP]  = TIMER_SIGNAL_ACTION_NONE;
+  settings->signal_actions[TIMER_SIGNAL_IDX_SIGUSR1] = TIMER_SIGNAL_ACTION_CANCEL;
+  settings->signal_actions[TIMER_SIGNAL_IDX_SIGUSR2] = TIMER_SIGNAL_ACTION_EXTEND;
+  settings->netclock_role                            = TIMER_NETCLOCK_ROLE_NONE;
+  settings->netclock_address                         = NULL;
+  settings->netclock_port                            = TIMER_NETCLOCK_PORT;
+  g_array_set_clear_func(settings->dwell_rules, (GDestroyNotify) clear_dwell_rule);
+  g_array_set_clear_func(settings->schedule,    (GDestroyNotify) clear_schedule_entry);
+
+  key_file = g_key_file_new();
+  if (data && g_key_file_load_from_data(key_file, data, length, G_KEY_FILE_NONE, NULL)) {
+    read_timeout(key_file, "Timer", "DefaultTimeout", &settings->default_timeout);
+    read_timeout(key_file, "Timer", "ExtendTimeout",  &settings->extend_timeout);
+    read_boolean(key_file, "Timer", "Shared",         &settings->shared);
+    read_suspend_policy(key_file, &settings->suspend_policy);
+    read_expiry_action(key_file, &settings->expiry_action);
+    read_duration(key_file, "Timer", "Slack", G_TIME_SPAN_MILLISECOND, TIMER_SLACK_MAX, &settings->slack);
+    read_boolean(key_file, "Timer", "CompensateExitLatency", &settings->compensate_latency);
+    read_duration(key_file, "Timer", "PreStop", G_TIME_SPAN_MILLISECOND, TIMER_PRESTOP_MAX, &settings->prestop);
+    read_optional_timeout(key_file, "Timer", "IdleExit", &settings->idle_exit);
+    read_duration(key_file, "Watchdog", "Budget", G_TIME_SPAN_SECOND, TIMER_WATCHDOG_MAX, &settings->watchdog_budget);
+    read_watchdog_recovery(key_file, &settings->watchdog_recovery);
+    read_dwell_rules(key_file, settings->dwell_rules);
+    read_schedule(key_file, settings->schedule);
+    read_netclock_role(key_file, &settings->netclock_role);
+    settings->netclock_address = g_key_file_get_string(key_file, "NetClock", "Address", NULL);
+    read_port(key_file, "NetClock", "Port", &settings->netclock_port);
+    for (i=0; i<TIMER_NUM_SIGNALS; i++) {
+      read_signal_action(key_file, signalKeys[i], &settings->signal_actions[i]);
+    }
+  }
+  g_key_file_free(key_file);
+
+  return settings;
+}
+
+
+/* Load the settings file (blocking), falling back to built-in defaults for anything not configured. */
+TimerSettings *
+timer_settings_load(void) {
+  TimerSettings *settings;
+  gchar         *path     = timer_settings_get_path();
+  gchar         *contents = NULL;
+  gsize          length   = 0;
+
+  g_file_get_contents(path, &contents, &length, NULL);
+  settings = timer_settings_parse(contents, length);
+  g_free(contents);
+  g_free(path);
+
+  return settings;
+}
+
+
+void
+timer_settings_free(TimerSettings *settings) {
+  g_array_free(settings->dwell_rules, TRUE);
+  g_array_free(settings->schedule, TRUE);
+  g_free(settings->netclock_address);
+  g_free(settings);
+}
+
+
+/* Parse the TIMER_STARTUP_ENV environment variable.
+   Returns TRUE if the timer should be armed at startup, setting *command and *value for timer_engine_command():
+   TIMER_COMMAND_ARM and the timeout (in microseconds) for a duration, TIMER_COMMAND_ARM_AT and the wall-clock
+   deadline for a time of day.
+   The variable is only honoured once per process, so re-activating the plugin doesn't re-arm the timer. */
+gboolean
+timer_settings_get_startup(TimerCommandType *command, gint64 *value) {
+  static gboolean  consumed = FALSE;
+  const gchar     *env;
+  guint            hour;
+  guint            minute;
+  gint             minutes;
+  gchar            unit;
+
+  if (consumed) {
+    return FALSE;
+  }
+  consumed = TRUE;
+
+  env = g_getenv(TIMER_STARTUP_ENV);
+  if (!env || !*env) {
+    return FALSE;
+  }
+
+  if (2 == sscanf(env, "%2u:%2u", &hour, &minute)) {
+    GDateTime *now;
+    GDateTime *today;
+    GDateTime *target;
+
+    if ((hour > 23) || (minute > 59)) {
+      g_warning("Timer: %s=%s is not a valid time of day, ignored", TIMER_STARTUP_ENV, env);
+      return FALSE;
+    }
+
+    now    = g_date_time_new_now_local();
+    today  = g_date_time_new_local(g_date_time_get_year(now),
+                                   g_date_time_get_month(now),
+                                   g_date_time_get_day_of_month(now),
+                                   hour, minute, 0);
+    target = (g_date_time_compare(today, now) > 0) ? g_date_time_ref(today) : g_date_time_add_days(today, 1);
+
+    *command = TIMER_COMMAND_ARM_AT;
+    *value   = g_date_time_to_unix(target) * G_USEC_PER_SEC;
+
+    g_date_time_unref(target);
+    g_date_time_unref(today);
+    g_date_time_unref(now);
+    return TRUE;
+  }
+
+  unit = 'm';
+  if ((sscanf(env, "%d%c", &minutes, &unit) < 1) || (unit != 'm') ||
+      (minutes < TIMER_MIN) || (minutes > TIMER_MAX)) {
+    g_warning("Timer: %s=%s is neither %d..%d minutes nor a time of day (HH:MM), ignored",
+              TIMER_STARTUP_ENV, env, TIMER_MIN, TIMER_MAX);
+    return FALSE;
+  }
+
+  *command = TIMER_COMMAND_ARM;
+  *value   = minutes * G_TIME_SPAN_MINUTE;
+  return TRUE;
+}
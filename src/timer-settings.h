@@ -0,0 +1,121 @@
+/*
+ * timer-settings.h
+ * User configuration of the timer plugin, read from
+ * $XDG_CONFIG_HOME/totem-plugin-timer/timer.conf (a GKeyFile).
+ *
+ *   Copyright (C) 2013 Christopher A. Doyle
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License along
+ *   with this program; if not, write to the Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef TIMER_SETTINGS_H
+#define TIMER_SETTINGS_H
+
+#include "timer-engine.h"
+
+#define TIMER_SETTINGS_DIR  "totem-plugin-timer"
+#define TIMER_SETTINGS_FILE "timer.conf"
+
+#define TIMER_STARTUP_ENV   "TOTEM_TIMER" /* environment variable arming the timer at startup */
+
+#define TIMER_EXTEND_DEFAULT (15) /* default value (in minutes) added to a running timer by an extend command */
+#define TIMER_SLACK_MAX      (60000) /* largest [Timer] Slack, in milliseconds */
+#define TIMER_PRESTOP_MAX    (60000) /* largest [Timer] PreStop, in milliseconds */
+#define TIMER_WATCHDOG_MAX   (3600)  /* largest [Watchdog] Budget, in seconds */
+#define TIMER_DWELL_MAX      (1440)  /* largest dwell time of a [Dwell] rule, in minutes */
+#define TIMER_NETCLOCK_PORT  (5637)  /* default [NetClock] Port */
+
+/* What to do with the timer when a configured POSIX signal is received. */
+typedef enum {
+  TIMER_SIGNAL_ACTION_NONE,   /* signal is not handled by the plugin */
+  TIMER_SIGNAL_ACTION_CANCEL, /* cancel the timer */
+  TIMER_SIGNAL_ACTION_EXTEND, /* add extend_timeout to the running timer */
+  TIMER_SIGNAL_ACTION_REARM   /* start/restart the timer with default_timeout */
+} TimerSignalActionType;
+
+/* What to do with a running timer when the machine resumes from suspend, see timer-logind.c. */
+typedef enum {
+  TIMER_SUSPEND_POLICY_COUNT,  /* suspend time counts, a deadline passed during suspend leaves TIMER_MIN minute(s) */
+  TIMER_SUSPEND_POLICY_FREEZE, /* the countdown is paused while suspended */
+  TIMER_SUSPEND_POLICY_EXPIRE  /* suspend time counts, a deadline passed during suspend expires immediately */
+} TimerSuspendPolicyType;
+
+/* What happens when the timer expires, see timer-expiry.c. */
+typedef enum {
+  TIMER_EXPIRY_ACTION_EXIT,    /* totem exits */
+  TIMER_EXPIRY_ACTION_SUSPEND, /* totem exits and the machine is suspended */
+  TIMER_EXPIRY_ACTION_POWEROFF /* totem exits and the machine is powered off */
+} TimerExpiryActionType;
+
+/* How the playback is recovered when the watchdog finds it stalled, see timer-watchdog.c. */
+typedef enum {
+  TIMER_WATCHDOG_RECOVERY_RELOAD, /* reload the current item, resuming at the stalled position */
+  TIMER_WATCHDOG_RECOVERY_SKIP,   /* skip to the next item of the playlist */
+  TIMER_WATCHDOG_RECOVERY_EXIT    /* save the snapshot and exit, for a supervisor to restart totem */
+} TimerWatchdogRecoveryType;
+
+/* Part the plugin takes in a clock shared over the network, see timer-netclock.c. */
+typedef enum {
+  TIMER_NETCLOCK_ROLE_NONE,     /* deadlines refer to the local wall clock */
+  TIMER_NETCLOCK_ROLE_PROVIDER, /* serve the local wall clock, deadlines refer to it */
+  TIMER_NETCLOCK_ROLE_CLIENT    /* deadlines refer to the clock served by a provider */
+} TimerNetClockRoleType;
+
+/* A rule of the [Dwell] group, see timer-dwell.c. */
+typedef struct {
+  gchar     *pattern; /* glob matched against the MRL of the item */
+  GTimeSpan  dwell;   /* longest time the item plays, in microseconds (configured in minutes), 0 for no limit */
+} TimerDwellRuleType;
+
+/* An entry of the [Schedule] group, see timer-schedule.c. */
+typedef struct {
+  guint  hour;   /* local time of the switch, every day */
+  guint  minute;
+  gchar *uri;    /* media or playlist replacing the playlist */
+} TimerScheduleEntryType;
+
+/* Signals that can be configured, see timer-signals.c.  The following must not contain any gaps. */
+#define TIMER_SIGNAL_IDX_SIGHUP  (0)
+#define TIMER_SIGNAL_IDX_SIGUSR1 (1)
+#define TIMER_SIGNAL_IDX_SIGUSR2 (2)
+#define TIMER_NUM_SIGNALS        (3)
+
+typedef struct {
+  TimeType                  default_timeout;                   /* [Timer] DefaultTimeout, in minutes */
+  TimeType                  extend_timeout;                    /* [Timer] ExtendTimeout, in minutes */
+  gboolean                  shared;                            /* [Timer] Shared, share the timer with other totem instances */
+  TimerSuspendPolicyType    suspend_policy;                    /* [Timer] Suspend */
+  TimerExpiryActionType     expiry_action;                     /* [Timer] ExpiryAction */
+  GTimeSpan                 slack;                             /* [Timer] Slack, in microseconds (configured in milliseconds) */
+  gboolean                  compensate_latency;                /* [Timer] CompensateExitLatency, see timer-latency.c */
+  GTimeSpan                 prestop;                           /* [Timer] PreStop, in microseconds (configured in milliseconds) */
+  TimeType                  idle_exit;                         /* [Timer] IdleExit, in minutes, 0 if disabled */
+  GTimeSpan                 watchdog_budget;                   /* [Watchdog] Budget, in microseconds (configured in seconds), 0 if disabled */
+  TimerWatchdogRecoveryType watchdog_recovery;                 /* [Watchdog] Recovery */
+  GArray                   *dwell_rules;                       /* [Dwell], of TimerDwellRuleType, in order */
+  GArray                   *schedule;                          /* [Schedule], of TimerScheduleEntryType */
+  TimerNetClockRoleType     netclock_role;                     /* [NetClock] Role */
+  gchar                    *netclock_address;                  /* [NetClock] Address, NULL for any (provider) */
+  gint                      netclock_port;                     /* [NetClock] Port */
+  TimerSignalActionType     signal_actions[TIMER_NUM_SIGNALS]; /* [Signals] SIGHUP, SIGUSR1, SIGUSR2 */
+} TimerSettings;
+
+gchar         *timer_settings_get_path(void);
+TimerSettings *timer_settings_parse(const gchar *data, gsize length);
+TimerSettings *timer_settings_load(void);
+void           timer_settings_free(TimerSettings *settings);
+gboolean       timer_settings_get_startup(TimerCommandType *command, gint64 *value);
+
+#endif /* TIMER_SETTINGS_H */
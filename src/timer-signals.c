@@ -0,0 +1,119 @@
+/*
+ * timer-signals.c
+ * Control of the timer through POSIX signals, for setups without a session bus.
+ * Each signal configured in the [Signals] group of the settings is mapped to
+ * a command and routed through timer_engine_command(), the same path used by
+ * the menu items, e.g.
+ *   kill -USR1 $(pidof totem)   # cancel the timer (default)
+ *   kill -USR2 $(pidof totem)   # extend the timer (default)
+ * The handlers run from the main loop (g_unix_signal_add()), not from signal context.
+ *
+ *   Copyright (C) 2013 Christopher A. Doyle
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License along
+ *   with this program; if not, write to the Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "config.h"
+
+#include <signal.h>
+#include <glib-unix.h>
+
+#include "timer-signals.h"
+
+/* Signal numbers, indexed by TIMER_SIGNAL_IDX_*. */
+static const gint signalNumbers [TIMER_NUM_SIGNALS] = {
+  SIGHUP,
+  SIGUSR1,
+  SIGUSR2
+};
+
+/* A handler installed for one signal. */
+typedef struct {
+  TimerEngine          *engine;
+  TimerSignalActionType action;
+  GTimeSpan             timeout; /* used by TIMER_SIGNAL_ACTION_EXTEND and TIMER_SIGNAL_ACTION_REARM */
+  guint                 source_id;
+} TimerSignalHandlerType;
+
+struct _TimerSignals {
+  TimerSignalHandlerType handlers[TIMER_NUM_SIGNALS];
+};
+
+
+static gboolean
+on_signal(TimerSignalHandlerType *handler) {
+  switch (handler->action) {
+  case TIMER_SIGNAL_ACTION_CANCEL:
+    timer_engine_command(handler->engine, TIMER_COMMAND_CANCEL, 0);
+    break;
+
+  case TIMER_SIGNAL_ACTION_EXTEND:
+    timer_engine_command(handler->engine, TIMER_COMMAND_EXTEND, handler->timeout);
+    break;
+
+  case TIMER_SIGNAL_ACTION_REARM:
+    timer_engine_command(handler->engine, TIMER_COMMAND_ARM, handler->timeout);
+    break;
+
+  default:
+    break;
+  }
+  return G_SOURCE_CONTINUE;
+}
+
+
+/* Install a main loop handler, controlling engine, for every signal that has an action configured. */
+TimerSignals *
+timer_signals_install(const TimerSettings *settings, TimerEngine *engine) {
+  TimerSignals *signals = g_new0(TimerSignals, 1);
+  guint         i;
+
+  for (i=0; i<TIMER_NUM_SIGNALS; i++) {
+    TimerSignalHandlerType *handler = &(signals->handlers[i]);
+
+    handler->engine = engine;
+    handler->action = settings->signal_actions[i];
+    switch (handler->action) {
+    case TIMER_SIGNAL_ACTION_EXTEND:
+      handler->timeout = settings->extend_timeout * G_TIME_SPAN_MINUTE;
+      break;
+    case TIMER_SIGNAL_ACTION_REARM:
+      handler->timeout = settings->default_timeout * G_TIME_SPAN_MINUTE;
+      break;
+    default:
+      handler->timeout = 0;
+      break;
+    }
+
+    if (handler->action != TIMER_SIGNAL_ACTION_NONE) {
+      handler->source_id = g_unix_signal_add(signalNumbers[i], (GSourceFunc) on_signal, handler);
+    }
+  }
+
+  return signals;
+}
+
+
+void
+timer_signals_remove(TimerSignals *signals) {
+  guint i;
+
+  for (i=0; i<TIMER_NUM_SIGNALS; i++) {
+    if (signals->handlers[i].source_id) {
+      g_source_remove(signals->handlers[i].source_id);
+    }
+  }
+  g_free(signals);
+}
@@ -0,0 +1,32 @@
+/*
+ * timer-signals.h
+ * Control of the timer through POSIX signals (SIGHUP, SIGUSR1, SIGUSR2).
+ *
+ *   Copyright (C) 2013 Christopher A. Doyle
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License along
+ *   with this program; if not, write to the Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef TIMER_SIGNALS_H
+#define TIMER_SIGNALS_H
+
+#include "timer-settings.h"
+
+typedef struct _TimerSignals TimerSignals;
+
+TimerSignals *timer_signals_install(const TimerSettings *settings, TimerEngine *engine);
+void          timer_signals_remove (TimerSignals *signals);
+
+#endif /* TIMER_SIGNALS_H */
@@ -0,0 +1,209 @@
+/*
+ * timer-snapshot.c
+ * Snapshot of the playlist and position, saved as a stage of the expiry so
+ * that the session can be picked up again, e.g.
+ *   [Snapshot]
+ *   Saved=1388534400000000
+ *   MRL=file:///home/user/Videos/movie.ogv
+ *   Position=5231000
+ *   PlaylistPosition=2
+ *   Titles=first.ogv;second.ogv;movie.ogv;
+ * where Saved is the wall-clock time (microseconds since the epoch) and
+ * Position the playback position (milliseconds) within MRL.
+ * The file is written with g_file_replace_contents_async(), so slow storage
+ * never blocks the main loop.  The write gets TIMER_SNAPSHOT_BUDGET: when
+ * it takes longer, the write is cancelled and the expiry carries on (totem
+ * exits) without waiting for it.  The budget is not critical and its
+ * timeout (g_timeout_add_seconds()) shares its wakeup with others.
+ *
+ *   Copyright (C) 2013 Christopher A. Doyle
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License along
+ *   with this program; if not, write to the Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "config.h"
+
+#include <string.h>
+#include <glib/gstdio.h>
+
+#include "timer-settings.h"
+#include "timer-snapshot.h"
+
+typedef struct _TimerSnapshotWrite TimerSnapshotWriteType;
+
+struct _TimerSnapshot {
+  TotemObject            *totem;
+  gchar                  *path;  /* of the snapshot file */
+  TimerSnapshotWriteType *write; /* pending write holding the stage, NULL if none */
+};
+
+/* A write in progress.  It outlives the stage when it misses its budget, until GIO reports its end. */
+struct _TimerSnapshotWrite {
+  TimerSnapshot *snapshot;    /* NULL once the stage completed */
+  TimerExpiry   *expiry;      /* whose stage completes with the write */
+  GCancellable  *cancellable;
+  guint          budget_id;   /* timeout source ending the budget, 0 if none */
+  gchar         *contents;    /* must stay valid until the write ends */
+  gint64         started;     /* monotonic time the write started */
+};
+
+
+/* Complete the stage holding write.  Only called while write->snapshot is set. */
+static void
+write_done(TimerSnapshotWriteType *write) {
+  if (write->budget_id) {
+    g_source_remove(write->budget_id);
+    write->budget_id = 0;
+  }
+  write->snapshot->write = NULL;
+  write->snapshot        = NULL;
+  timer_expiry_stage_done(write->expiry);
+}
+
+
+static void
+write_free(TimerSnapshotWriteType *write) {
+  g_object_unref(write->cancellable);
+  g_free(write->contents);
+  g_free(write);
+}
+
+
+static gboolean
+on_budget_spent(TimerSnapshotWriteType *write) {
+  g_warning("Timer: snapshot not written within %d ms, carrying on without it",
+            (gint) (TIMER_SNAPSHOT_BUDGET / 1000));
+  write->budget_id = 0;
+  g_cancellable_cancel(write->cancellable);
+  write_done(write);
+  return G_SOURCE_REMOVE;
+}
+
+
+/* Called by GIO once the write ended, whether it succeeded, failed, or was cancelled. */
+static void
+on_written(GObject *source, GAsyncResult *result, gpointer user_data) {
+  TimerSnapshotWriteType *write = user_data;
+  GError                 *error = NULL;
+
+  if (!g_file_replace_contents_finish(G_FILE(source), result, NULL, &error)) {
+    if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+      g_warning("Timer: could not write the snapshot: %s", error->message);
+    }
+    g_error_free(error);
+  } else {
+    g_debug("Timer: snapshot written in %" G_GINT64_FORMAT " us", g_get_monotonic_time() - write->started);
+  }
+
+  if (write->snapshot) {
+    write_done(write); /* within the budget */
+  }
+  write_free(write);
+}
+
+
+static gchar *
+build_contents(TimerSnapshot *snapshot) {
+  TotemObject  *totem    = snapshot->totem;
+  GKeyFile     *key_file = g_key_file_new();
+  gchar        *mrl;
+  gchar        *contents;
+  gchar       **titles;
+  guint         length;
+  guint         i;
+
+  g_key_file_set_int64(key_file, "Snapshot", "Saved", g_get_real_time());
+
+  mrl = totem_get_current_mrl(totem);
+  if (mrl) {
+    g_key_file_set_string(key_file, "Snapshot", "MRL",      mrl);
+    g_key_file_set_int64 (key_file, "Snapshot", "Position", totem_get_current_time(totem));
+    g_free(mrl);
+  }
+
+  length = totem_get_playlist_length(totem);
+  titles = g_new0(gchar *, length + 1);
+  for (i=0; i<length; i++) {
+    titles[i] = totem_get_title_at_playlist_pos(totem, i);
+    if (!titles[i]) {
+      titles[i] = g_strdup("");
+    }
+  }
+  g_key_file_set_integer    (key_file, "Snapshot", "PlaylistPosition", totem_get_playlist_pos(totem));
+  g_key_file_set_string_list(key_file, "Snapshot", "Titles", (const gchar * const *) titles, length);
+  g_strfreev(titles);
+
+  contents = g_key_file_to_data(key_file, NULL, NULL);
+  g_key_file_free(key_file);
+  return contents;
+}
+
+
+TimerSnapshot *
+timer_snapshot_new(TotemObject *totem) {
+  TimerSnapshot *snapshot = g_new0(TimerSnapshot, 1);
+  gchar         *dir;
+
+  /* created now rather than on expiry, so that the stage itself does no blocking I/O */
+  dir             = g_build_filename(g_get_user_data_dir(), TIMER_SETTINGS_DIR, NULL);
+  snapshot->totem = totem;
+  snapshot->path  = g_build_filename(dir, TIMER_SNAPSHOT_FILE, NULL);
+  g_mkdir_with_parents(dir, 0700);
+  g_free(dir);
+
+  return snapshot;
+}
+
+
+void
+timer_snapshot_free(TimerSnapshot *snapshot) {
+  if (snapshot->write) {
+    /* let the write end on its own, without completing the stage of an expiry that is going away */
+    g_source_remove(snapshot->write->budget_id);
+    snapshot->write->budget_id = 0;
+    snapshot->write->snapshot  = NULL;
+    g_cancellable_cancel(snapshot->write->cancellable);
+  }
+  g_free(snapshot->path);
+  g_free(snapshot);
+}
+
+
+/* Expiry stage (see timer_expiry_add_stage()) saving the snapshot. */
+void
+timer_snapshot_stage(TimerExpiry *expiry, TimerSnapshot *snapshot) {
+  TimerSnapshotWriteType *write = g_new0(TimerSnapshotWriteType, 1);
+  GFile                  *file;
+
+  write->snapshot    = snapshot;
+  write->expiry      = expiry;
+  write->cancellable = g_cancellable_new();
+  write->contents    = build_contents(snapshot);
+  write->started     = g_get_monotonic_time();
+  write->budget_id   = g_timeout_add_seconds(TIMER_SNAPSHOT_BUDGET / G_TIME_SPAN_SECOND, (GSourceFunc) on_budget_spent, write);
+  snapshot->write    = write;
+
+  file = g_file_new_for_path(snapshot->path);
+  g_file_replace_contents_async(file,
+                                write->contents,
+                                strlen(write->contents),
+                                NULL,
+                                FALSE,
+                                G_FILE_CREATE_PRIVATE | G_FILE_CREATE_REPLACE_DESTINATION,
+                                write->cancellable,
+                                on_written,
+                                write);
+  g_object_unref(file);
+}
@@ -0,0 +1,38 @@
+/*
+ * timer-snapshot.h
+ * Snapshot of the playlist and position, saved as a stage of the expiry.
+ *
+ *   Copyright (C) 2013 Christopher A. Doyle
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License along
+ *   with this program; if not, write to the Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef TIMER_SNAPSHOT_H
+#define TIMER_SNAPSHOT_H
+
+#include <totem.h>
+
+#include "timer-expiry.h"
+
+#define TIMER_SNAPSHOT_FILE   "snapshot"               /* in $XDG_DATA_HOME/TIMER_SETTINGS_DIR */
+#define TIMER_SNAPSHOT_BUDGET (2 * G_TIME_SPAN_SECOND) /* time the write may take before the expiry carries on */
+
+typedef struct _TimerSnapshot TimerSnapshot;
+
+TimerSnapshot *timer_snapshot_new  (TotemObject *totem);
+void           timer_snapshot_free (TimerSnapshot *snapshot);
+void           timer_snapshot_stage(TimerExpiry *expiry, TimerSnapshot *snapshot);
+
+#endif /* TIMER_SNAPSHOT_H */
@@ -0,0 +1,147 @@
+/*
+ * timer-status.c
+ * Status page: the state of the timer (armed, deadline, mode and time of
+ * the last expiry) published in $XDG_RUNTIME_DIR/totem-plugin-timer/status-<pid>
+ * (status-<pid>-<n> for plugin instance n > 0 of the process), a file
+ * holding a TimerStatusPageType (see timer-status.h).
+ * The page is only written when the state changes, and an external monitor
+ * maps the file and samples it at will without talking to totem.  The page
+ * is protected by a seqlock: the writer makes sequence odd, updates the
+ * fields, then makes sequence even again.  A reader
+ *   1. reads sequence, retrying while it is odd,
+ *   2. copies the fields,
+ *   3. reads sequence again and retries from 1. if it changed,
+ * with a read barrier between each step (e.g. __atomic_load_n with
+ * __ATOMIC_ACQUIRE for both reads of sequence).  Readers never block the
+ * writer, and any number of them may sample the page.
+ * The file is removed when the plugin is deactivated; a file left by a
+ * crashed totem can be recognised by its pid.
+ *
+ *   Copyright (C) 2013 Christopher A. Doyle
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License along
+ *   with this program; if not, write to the Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <glib/gstdio.h>
+
+#include "timer-settings.h"
+#include "timer-status.h"
+
+struct _TimerStatus {
+  TimerEngine         *engine;
+  gchar               *path; /* of the status file */
+  TimerStatusPageType *page; /* the mapped file, NULL if it couldn't be created */
+};
+
+
+/* Rewrite the page from the state of the engine.  Only the main thread writes, so there is a single writer. */
+static void
+update(TimerStatus *status, gint64 last_expiry) {
+  TimerStatusPageType *page = status->page;
+
+  if (!page) {
+    return;
+  }
+
+  g_atomic_int_inc((gint *) &page->sequence); /* odd: update in progress (full barrier) */
+  page->armed    = timer_engine_is_armed(status->engine) ? 1 : 0;
+  page->mode     = timer_engine_get_mode(status->engine);
+  page->deadline = timer_engine_get_deadline(status->engine);
+  if (last_expiry) {
+    page->last_expiry = last_expiry;
+  }
+  g_atomic_int_inc((gint *) &page->sequence); /* even: consistent again (full barrier) */
+}
+
+
+static void
+on_engine_changed(TimerStatus *status) {
+  update(status, 0);
+}
+
+
+static void
+on_engine_expired(TimerEngine *engine, TimerStatus *status) {
+  update(status, g_get_real_time());
+}
+
+
+/* Create the status page of engine, for plugin instance instance (0 for the first one), and keep it up to date. */
+TimerStatus *
+timer_status_new(TimerEngine *engine, guint instance) {
+  TimerStatus *status = g_new0(TimerStatus, 1);
+  gchar       *dir;
+  gchar       *name;
+  gpointer     page;
+  gint         fd;
+
+  status->engine = engine;
+
+  dir          = g_build_filename(g_get_user_runtime_dir(), TIMER_SETTINGS_DIR, NULL);
+  name         = instance ? g_strdup_printf(TIMER_STATUS_FILE_N, (gint) getpid(), instance)
+                          : g_strdup_printf(TIMER_STATUS_FILE, (gint) getpid());
+  status->path = g_build_filename(dir, name, NULL);
+  g_mkdir_with_parents(dir, 0700);
+  g_free(name);
+  g_free(dir);
+
+  fd = g_open(status->path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    g_warning("Timer: could not create %s: %s", status->path, g_strerror(errno));
+    return status;
+  }
+  if (ftruncate(fd, sizeof(TimerStatusPageType)) < 0) {
+    g_warning("Timer: could not size %s: %s", status->path, g_strerror(errno));
+    close(fd);
+    return status;
+  }
+  page = mmap(NULL, sizeof(TimerStatusPageType), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd); /* the mapping keeps the file */
+  if (page == MAP_FAILED) {
+    g_warning("Timer: could not map %s: %s", status->path, g_strerror(errno));
+    return status;
+  }
+
+  /* the file is zero-filled (sequence 0), readers check magic before trusting the rest */
+  status->page          = page;
+  status->page->version = TIMER_STATUS_VERSION;
+  update(status, 0);
+  g_atomic_int_set((gint *) &status->page->magic, TIMER_STATUS_MAGIC);
+
+  g_signal_connect_swapped(engine, "notify::armed",    G_CALLBACK(on_engine_changed), status);
+  g_signal_connect_swapped(engine, "notify::deadline", G_CALLBACK(on_engine_changed), status);
+  g_signal_connect_swapped(engine, "notify::mode",     G_CALLBACK(on_engine_changed), status);
+  g_signal_connect(engine, "expired", G_CALLBACK(on_engine_expired), status);
+
+  return status;
+}
+
+
+void
+timer_status_free(TimerStatus *status) {
+  g_signal_handlers_disconnect_by_data(status->engine, status);
+  if (status->page) {
+    munmap(status->page, sizeof(TimerStatusPageType));
+  }
+  g_unlink(status->path);
+  g_free(status->path);
+  g_free(status);
+}
@@ -0,0 +1,53 @@
+/*
+ * timer-status.h
+ * Status page: the state of the timer in a small memory-mapped file, for
+ * external monitors (see timer-status.c).
+ *
+ *   Copyright (C) 2013 Christopher A. Doyle
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License along
+ *   with this program; if not, write to the Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef TIMER_STATUS_H
+#define TIMER_STATUS_H
+
+#include <glib.h>
+
+#include "timer-engine.h"
+
+#define TIMER_STATUS_FILE    "status-%d"    /* in $XDG_RUNTIME_DIR/TIMER_SETTINGS_DIR, %d being the pid of totem */
+#define TIMER_STATUS_FILE_N  "status-%d-%u" /* same for plugin instance %u > 0 of the process */
+#define TIMER_STATUS_MAGIC   (0x544d5253) /* "TMRS" */
+#define TIMER_STATUS_VERSION (1)
+
+/* Layout of the file (native byte order).  Readers must follow the seqlock protocol described in
+   timer-status.c, as the page is updated in place. */
+typedef struct {
+  guint32 magic;       /* TIMER_STATUS_MAGIC */
+  guint32 version;     /* TIMER_STATUS_VERSION */
+  guint32 sequence;    /* odd while an update is in progress */
+  guint32 armed;       /* 1 while the timer is running, else 0 */
+  gint32  mode;        /* TimerEngineMode of the last arm */
+  guint32 reserved;
+  gint64  deadline;    /* wall-clock time of expiry (microseconds since the epoch), 0 if not running */
+  gint64  last_expiry; /* wall-clock time the timer last expired, 0 if it never did */
+} TimerStatusPageType;
+
+typedef struct _TimerStatus TimerStatus;
+
+TimerStatus *timer_status_new (TimerEngine *engine, guint instance);
+void         timer_status_free(TimerStatus *status);
+
+#endif /* TIMER_STATUS_H */
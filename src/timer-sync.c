@@ -0,0 +1,242 @@
+/*
+ * timer-sync.c
+ * Sharing of the timer between several totem instances on the same machine.
+ * The state of the shared timer is kept in a small key file in
+ * $XDG_RUNTIME_DIR/totem-plugin-timer, e.g.
+ *   [Timer]
+ *   Owner=1234
+ *   State=armed
+ *   Deadline=5401234567
+ * where Deadline is in g_get_monotonic_time() units (CLOCK_MONOTONIC is
+ * system wide, so all instances agree on it) and State is one of armed,
+ * cancelled or expired.
+ * Every instance watches the file (GFileMonitor, i.e. inotify) rather than
+ * polling it:
+ *   - the instance that last armed/extended/cancelled the timer writes the
+ *     file and becomes the owner, its engine performs the wakeup at Deadline
+ *     and it writes State=expired before running the expiry,
+ *   - every other instance (a follower) arms its own engine TIMER_SYNC_GRACE
+ *     after Deadline and runs the expiry when it sees State=expired.  Should
+ *     the owner die before reporting the expiry, the first follower to wake
+ *     up reports it instead.  (The remaining time reported by a follower
+ *     includes TIMER_SYNC_GRACE.)
+ * The local engine's armed, cancelled and expired signals are published to
+ * the file; an expiry reported by another instance is applied with
+ * TIMER_COMMAND_EXPIRE, so the expired signal of every instance fires.
+ *
+ *   Copyright (C) 2013 Christopher A. Doyle
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License along
+ *   with this program; if not, write to the Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "config.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <glib/gstdio.h>
+
+#include "timer-settings.h"
+#include "timer-sync.h"
+
+#define SYNC_STATE_ARMED     "armed"
+#define SYNC_STATE_CANCELLED "cancelled"
+#define SYNC_STATE_EXPIRED   "expired"
+
+struct _TimerSync {
+  TimerEngine  *engine;   /* local timer */
+  gchar        *path;     /* of the state file */
+  GFileMonitor *monitor;  /* watching the state file */
+  gchar        *contents; /* contents of the state file last written or applied */
+  gboolean      applying; /* true while applying the state of another instance (so it isn't published back) */
+};
+
+
+static gboolean
+pid_alive(gint pid) {
+  return (pid > 0) && ((kill(pid, 0) == 0) || (errno == EPERM));
+}
+
+
+static void
+write_state(TimerSync *sync, const gchar *state, gint64 deadline) {
+  GKeyFile *key_file = g_key_file_new();
+  GError   *error    = NULL;
+
+  g_key_file_set_integer(key_file, "Timer", "Owner",    getpid());
+  g_key_file_set_string (key_file, "Timer", "State",    state);
+  g_key_file_set_int64  (key_file, "Timer", "Deadline", deadline);
+
+  g_free(sync->contents);
+  sync->contents = g_key_file_to_data(key_file, NULL, NULL);
+  if (!g_file_set_contents(sync->path, sync->contents, -1, &error)) {
+    g_warning("Timer: could not write %s: %s", sync->path, error->message);
+    g_error_free(error);
+  }
+  g_key_file_free(key_file);
+}
+
+
+/* Apply the state written by another instance.  At startup an expiry is stale and is ignored. */
+static void
+read_state(TimerSync *sync, gboolean startup) {
+  GKeyFile *key_file;
+  gchar    *contents = NULL;
+  gchar    *state    = NULL;
+  gint      owner;
+  gint64    deadline;
+
+  if (!g_file_get_contents(sync->path, &contents, NULL, NULL)) {
+    return;
+  }
+  if (g_strcmp0(contents, sync->contents) == 0) {
+    g_free(contents);
+    return; /* nothing new (e.g. our own write, or several events for one change) */
+  }
+  g_free(sync->contents);
+  sync->contents = contents;
+
+  key_file = g_key_file_new();
+  if (!g_key_file_load_from_data(key_file, contents, -1, G_KEY_FILE_NONE, NULL)) {
+    g_key_file_free(key_file);
+    return;
+  }
+  owner    = g_key_file_get_integer(key_file, "Timer", "Owner",    NULL);
+  state    = g_key_file_get_string (key_file, "Timer", "State",    NULL);
+  deadline = g_key_file_get_int64  (key_file, "Timer", "Deadline", NULL);
+  g_key_file_free(key_file);
+
+  if (owner == getpid()) {
+    g_free(state);
+    return;
+  }
+
+  sync->applying = TRUE;
+  if (g_strcmp0(state, SYNC_STATE_ARMED) == 0) {
+    GTimeSpan timeout = deadline - g_get_monotonic_time();
+
+    if (startup && !pid_alive(owner)) {
+      /* nobody performs the wakeup for this deadline any more, take it over */
+      sync->applying = FALSE;
+    } else {
+      timeout += TIMER_SYNC_GRACE;
+    }
+    if (timeout > 0) {
+      timer_engine_command(sync->engine, TIMER_COMMAND_ARM, timeout);
+    }
+
+  } else if (g_strcmp0(state, SYNC_STATE_CANCELLED) == 0) {
+    if (!startup) {
+      timer_engine_command(sync->engine, TIMER_COMMAND_CANCEL, 0);
+    }
+
+  } else if (g_strcmp0(state, SYNC_STATE_EXPIRED) == 0) {
+    if (!startup) {
+      timer_engine_command(sync->engine, TIMER_COMMAND_EXPIRE, 0);
+    }
+  }
+  sync->applying = FALSE;
+
+  g_free(state);
+}
+
+
+static void
+on_state_changed(GFileMonitor      *monitor,
+                 GFile             *file,
+                 GFile             *other_file,
+                 GFileMonitorEvent  event_type,
+                 TimerSync         *sync) {
+  if ((event_type == G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT) || (event_type == G_FILE_MONITOR_EVENT_CREATED)) {
+    read_state(sync, FALSE);
+  }
+}
+
+
+/* The local timer was armed or extended; shares the new deadline with the other instances. */
+static void
+on_engine_armed(TimerEngine *engine, TimerSync *sync) {
+  if (!sync->applying) {
+    write_state(sync, SYNC_STATE_ARMED, g_get_monotonic_time() + timer_engine_get_remaining(engine));
+  }
+}
+
+
+static void
+on_engine_cancelled(TimerEngine *engine, TimerSync *sync) {
+  if (!sync->applying) {
+    write_state(sync, SYNC_STATE_CANCELLED, 0);
+  }
+}
+
+
+/* The local timer expired; reports it before the expiry runs (the plugin exits in a handler connected after). */
+static void
+on_engine_expired(TimerEngine *engine, TimerSync *sync) {
+  if (!sync->applying) {
+    write_state(sync, SYNC_STATE_EXPIRED, 0);
+  }
+}
+
+
+/* Start watching the shared state, adopting into engine a timer already armed by another instance,
+   and publish the changes of engine to the other instances. */
+TimerSync *
+timer_sync_new(TimerEngine *engine) {
+  TimerSync *sync  = g_new0(TimerSync, 1);
+  gchar     *dir;
+  GFile     *file;
+  GError    *error = NULL;
+
+  sync->engine = engine;
+
+  dir        = g_build_filename(g_get_user_runtime_dir(), TIMER_SETTINGS_DIR, NULL);
+  sync->path = g_build_filename(dir, TIMER_SYNC_FILE, NULL);
+  g_mkdir_with_parents(dir, 0700);
+  g_free(dir);
+
+  file          = g_file_new_for_path(sync->path);
+  sync->monitor = g_file_monitor_file(file, G_FILE_MONITOR_NONE, NULL, &error);
+  if (sync->monitor) {
+    g_signal_connect(sync->monitor, "changed", G_CALLBACK(on_state_changed), sync);
+  } else {
+    g_warning("Timer: could not watch %s: %s", sync->path, error->message);
+    g_error_free(error);
+  }
+  g_object_unref(file);
+
+  g_signal_connect(engine, "armed",     G_CALLBACK(on_engine_armed),     sync);
+  g_signal_connect(engine, "cancelled", G_CALLBACK(on_engine_cancelled), sync);
+  g_signal_connect(engine, "expired",   G_CALLBACK(on_engine_expired),   sync);
+
+  read_state(sync, TRUE);
+
+  return sync;
+}
+
+
+void
+timer_sync_free(TimerSync *sync) {
+  g_signal_handlers_disconnect_by_data(sync->engine, sync);
+  if (sync->monitor) {
+    g_signal_handlers_disconnect_by_func(sync->monitor, on_state_changed, sync);
+    g_file_monitor_cancel(sync->monitor);
+    g_object_unref(sync->monitor);
+  }
+  g_free(sync->contents);
+  g_free(sync->path);
+  g_free(sync);
+}
+
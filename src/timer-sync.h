@@ -0,0 +1,37 @@
+/*
+ * timer-sync.h
+ * Sharing of the timer between several totem instances on the same machine.
+ *
+ *   Copyright (C) 2013 Christopher A. Doyle
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License along
+ *   with this program; if not, write to the Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef TIMER_SYNC_H
+#define TIMER_SYNC_H
+
+#include <gio/gio.h>
+
+#include "timer-engine.h"
+
+#define TIMER_SYNC_FILE  "timer.state"            /* in $XDG_RUNTIME_DIR/TIMER_SETTINGS_DIR */
+#define TIMER_SYNC_GRACE (5 * G_TIME_SPAN_SECOND) /* delay after which a follower takes over an expiry the owner didn't report */
+
+typedef struct _TimerSync TimerSync;
+
+TimerSync *timer_sync_new (TimerEngine *engine);
+void       timer_sync_free(TimerSync *sync);
+
+#endif /* TIMER_SYNC_H */
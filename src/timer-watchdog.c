@@ -0,0 +1,177 @@
+/*
+ * timer-watchdog.c
+ * Watchdog recovering a playback that stopped making progress ([Watchdog]
+ * group of the settings): while totem claims to be playing, its position
+ * (notify::current-time, as reported by the pipeline) must move at least
+ * once per Budget seconds.  Otherwise the playback is considered stalled
+ * (stuck buffering, frozen pipeline) and is recovered by
+ *   reload  stopping and restarting the current item, resuming at the
+ *           position it stalled at,
+ *   skip    going to the next item of the playlist,
+ *   exit    saving the snapshot and exiting, for a supervisor to restart
+ *           totem (without the ExpiryAction of the timer).
+ * The deadline is kept by a TimerEngine of its own, armed when the playback
+ * starts and cancelled when it stops.  Progress only records its time (the
+ * position is reported several times per second): when the engine expires
+ * after some progress, it is re-armed for the rest of the budget.
+ * Stalls are counted in the watchdog-stalls metric.
+ *
+ *   Copyright (C) 2013 Christopher A. Doyle
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License along
+ *   with this program; if not, write to the Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "config.h"
+
+#include "timer-engine.h"
+#include "timer-metrics.h"
+#include "timer-watchdog.h"
+
+struct _TimerWatchdog {
+  TotemObject               *totem;
+  TimerEngine               *engine;          /* keeping the deadline of the progress */
+  GTimeSpan                  budget;          /* longest time without progress while playing, 0 to disable */
+  TimerWatchdogRecoveryType  recovery;
+  gint64                     position;        /* last position reported by totem (milliseconds) */
+  gint64                     progressed;      /* monotonic time the position last moved */
+  gint64                     resume_position; /* position to seek to once a reloaded item plays, -1 if none */
+  TimerWatchdogFunc          exit_func;
+  gpointer                   user_data;
+};
+
+
+/* Arm the engine while totem plays (and the watchdog is enabled), cancel it otherwise. */
+static void
+update(TimerWatchdog *watchdog) {
+  if ((watchdog->budget > 0) && totem_is_playing(watchdog->totem)) {
+    if (!timer_engine_is_armed(watchdog->engine)) {
+      watchdog->progressed = g_get_monotonic_time();
+      timer_engine_command(watchdog->engine, TIMER_COMMAND_ARM, watchdog->budget);
+    }
+  } else {
+    timer_engine_command(watchdog->engine, TIMER_COMMAND_CANCEL, 0);
+  }
+}
+
+
+static void
+recover(TimerWatchdog *watchdog) {
+  TotemObject *totem = watchdog->totem;
+
+  timer_metrics_add("watchdog-stalls", 1);
+  g_warning("Timer: no playback progress for %" G_GINT64_FORMAT " s at %" G_GINT64_FORMAT " ms, recovering",
+            watchdog->budget / G_TIME_SPAN_SECOND, watchdog->position);
+
+  switch (watchdog->recovery) {
+  case TIMER_WATCHDOG_RECOVERY_RELOAD:
+    watchdog->resume_position = watchdog->position;
+    totem_action_stop(totem);
+    totem_action_play(totem);
+    break;
+  case TIMER_WATCHDOG_RECOVERY_SKIP:
+    totem_action_next(totem);
+    break;
+  case TIMER_WATCHDOG_RECOVERY_EXIT:
+    watchdog->exit_func(watchdog->user_data);
+    return;
+  default:
+    break;
+  }
+
+  /* the playing state may not have changed: start a new budget */
+  update(watchdog);
+}
+
+
+static void
+on_engine_expired(TimerEngine *engine, TimerWatchdog *watchdog) {
+  GTimeSpan left = watchdog->progressed + watchdog->budget - g_get_monotonic_time();
+
+  if (!totem_is_playing(watchdog->totem)) {
+    return;
+  }
+  if (left > 0) {
+    timer_engine_command(engine, TIMER_COMMAND_ARM, left); /* there was progress meanwhile */
+    return;
+  }
+  recover(watchdog);
+}
+
+
+static void
+on_position_changed(TimerWatchdog *watchdog) {
+  gint64 position = totem_get_current_time(watchdog->totem);
+
+  if (position != watchdog->position) {
+    watchdog->position   = position;
+    watchdog->progressed = g_get_monotonic_time();
+  }
+}
+
+
+static void
+on_playing_changed(TimerWatchdog *watchdog) {
+  if ((watchdog->resume_position >= 0) && totem_is_playing(watchdog->totem)) {
+    totem_action_seek_time(watchdog->totem, watchdog->resume_position, FALSE);
+    watchdog->resume_position = -1;
+  }
+  update(watchdog);
+}
+
+
+/* Watch the playback progress of totem, as configured by settings.  exit_func is called for the exit recovery. */
+TimerWatchdog *
+timer_watchdog_new(const TimerSettings *settings, TotemObject *totem, TimerWatchdogFunc exit_func, gpointer user_data) {
+  TimerWatchdog *watchdog = g_new0(TimerWatchdog, 1);
+
+  watchdog->totem           = totem;
+  watchdog->engine          = timer_engine_new();
+  watchdog->budget          = settings->watchdog_budget;
+  watchdog->recovery        = settings->watchdog_recovery;
+  watchdog->position        = -1;
+  watchdog->resume_position = -1;
+  watchdog->exit_func       = exit_func;
+  watchdog->user_data       = user_data;
+
+  timer_engine_set_slack(watchdog->engine, settings->slack);
+  g_signal_connect(watchdog->engine, "expired", G_CALLBACK(on_engine_expired), watchdog);
+  g_signal_connect_swapped(totem, "notify::current-time", G_CALLBACK(on_position_changed), watchdog);
+  g_signal_connect_swapped(totem, "notify::playing",      G_CALLBACK(on_playing_changed),  watchdog);
+  update(watchdog);
+
+  return watchdog;
+}
+
+
+void
+timer_watchdog_free(TimerWatchdog *watchdog) {
+  g_signal_handlers_disconnect_by_data(watchdog->totem, watchdog);
+  g_signal_handlers_disconnect_by_data(watchdog->engine, watchdog);
+  g_object_unref(watchdog->engine);
+  g_free(watchdog);
+}
+
+
+/* Apply changed settings.  A new budget starts right away. */
+void
+timer_watchdog_configure(TimerWatchdog *watchdog, const TimerSettings *settings) {
+  timer_engine_set_slack(watchdog->engine, settings->slack);
+  watchdog->recovery = settings->watchdog_recovery;
+  if (watchdog->budget != settings->watchdog_budget) {
+    watchdog->budget = settings->watchdog_budget;
+    timer_engine_command(watchdog->engine, TIMER_COMMAND_CANCEL, 0);
+    update(watchdog);
+  }
+}
@@ -0,0 +1,38 @@
+/*
+ * timer-watchdog.h
+ * Watchdog recovering a playback that stopped making progress.
+ *
+ *   Copyright (C) 2013 Christopher A. Doyle
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License along
+ *   with this program; if not, write to the Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef TIMER_WATCHDOG_H
+#define TIMER_WATCHDOG_H
+
+#include <totem.h>
+
+#include "timer-settings.h"
+
+typedef struct _TimerWatchdog TimerWatchdog;
+
+/* Called for TIMER_WATCHDOG_RECOVERY_EXIT, normally makes totem exit. */
+typedef void (*TimerWatchdogFunc)(gpointer user_data);
+
+TimerWatchdog *timer_watchdog_new      (const TimerSettings *settings, TotemObject *totem, TimerWatchdogFunc exit_func, gpointer user_data);
+void           timer_watchdog_free     (TimerWatchdog *watchdog);
+void           timer_watchdog_configure(TimerWatchdog *watchdog, const TimerSettings *settings);
+
+#endif /* TIMER_WATCHDOG_H */
@@ -38,47 +38,93 @@
 #include <totem-plugin.h>
 #include "totem-interface.h"
 
+#include "timer-engine.h"
+#include "timer-config.h"
+#include "timer-dbus.h"
+#include "timer-dwell.h"
+#include "timer-expiry.h"
+#include "timer-idle.h"
+#include "timer-latency.h"
+#include "timer-logind.h"
+#include "timer-metrics.h"
+#include "timer-netclock.h"
+#include "timer-prestop.h"
+#include "timer-qos.h"
+#include "timer-schedule.h"
+#include "timer-settings.h"
+#include "timer-signals.h"
+#include "timer-snapshot.h"
+#include "timer-status.h"
+#include "timer-sync.h"
+#include "timer-watchdog.h"
+
 #define TOTEM_TYPE_TIMER_PLUGIN (totem_timer_plugin_get_type())
 #define TOTEM_TIMER_PLUGIN(o)   (G_TYPE_CHECK_INSTANCE_CAST ((o), TOTEM_TYPE_TIMER_PLUGIN, TotemTimerPlugin))
 
 #define ACTION_GROUP "TimerActions"
 #define ACTION_NAME  "Timer"
 
-/* Adjustable timer constants */
-#define TIMER_MIN (1)          /* minimum possible timeout value (in minutes) */
-#define TIMER_MAX (999)        /* maximum possible timeout value (in minutes) */
-#define TIMER_ADJ_DEFAULT (60) /* default timeout value (in minutes) for adjustable timer */
-#define TIMER_CANCEL (0)       /* any value outside of TIMER_MIN..TIMER_MAX will cancel timer */
+#ifdef HAVE_TOTEM_GMENU
+#define ACTION_PREFIX "timer"            /* actions are "timer.arm", "timer.cancel", "timer.adjust" and "timer.shown" */
+#define MENU_SECTION  "save-placeholder" /* menu section of totem the Timer sub-menu is added to */
+#endif
 
 typedef struct {
-  TotemObject    *totem;
-  GtkActionGroup *action_group;
-  GtkActionEntry *action_entries;
-  guint           ui_merge_id;
-  GThread        *timer_thread;
+  TotemObject        *totem;
+  TimerEngine        *engine;
+#ifdef HAVE_TOTEM_GMENU
+  GSimpleActionGroup *actions;
+  GMenu              *menu;
+#else
+  GtkActionGroup     *action_group;
+  GtkActionEntry     *action_entries;
+  guint               ui_merge_id;
+#endif
+  TimerConfig        *config;
+  TimerDBus          *dbus;
+  TimerSignals       *signals;
+  TimerSync          *sync;
+  TimerLogind        *logind;
+  TimerExpiry        *expiry;
+  TimerSnapshot      *snapshot;
+  TimerStatus        *status;
+  TimerPrestop       *prestop;
+  TimerIdle          *idle;
+  TimerWatchdog      *watchdog;
+  TimerDwell         *dwell;
+  TimerQos           *qos;
+  TimerSchedule      *schedule;
+  TimerNetClock      *netclock;
+  GTimeSpan           exit_latency;     /* estimated time from expiry to exit, see timer-latency.c */
+  guint               deferred_id;      /* idle source running the deferred activation, 0 once it ran */
+  gint64              menu_opening;     /* monotonic time the Timer sub-menu was last asked to open */
+  guint               menu_opened_id;   /* idle source timing the opening of the Timer sub-menu, 0 if none */
+  gint64              activated;        /* monotonic time impl_activate() was called */
+  guint               instance;         /* index of this plugin instance in the process, see activeInstances */
+  TimerCommandType    startup_command;  /* arming the timer requested by the environment, see startup_deadline */
+  gint64              startup_deadline; /* monotonic time the startup timeout ends (TIMER_COMMAND_ARM) or wall-clock
+                                           time of the startup deadline (TIMER_COMMAND_ARM_AT), 0 if none */
 } TotemTimerPluginPrivate;
 
-TOTEM_PLUGIN_REGISTER(TOTEM_TYPE_TIMER_PLUGIN, TotemTimerPlugin, totem_timer_plugin)
-
-typedef gint16 TimeType; /* Timeout value in minutes. Normally values are between TIMER_MIN..TIMER_MAX,
-                            but values outside this range can be used to signal special cases (e.g. cancel timer). */
+/* Plugin instances active in the process, bit n standing for instance n.  The first instance (0) uses the
+   resources of the process as such (D-Bus path, status page), later ones get their own (see timer-dbus.c and
+   timer-status.c).  Only touched on the main thread. */
+static guint32 activeInstances = 0;
 
-/* Structure defining data that is shared between the GUI thread and the timer_function thread. */
-typedef struct {
-  gboolean new;       /* true indicates new data that timer_function thread hasn't processed yet */
-  gboolean terminate; /* true indicates that timer_function thread should terminate/exit */
-  TimeType timeout;   /* timeout value (in minutes) to configure timer with (any value outside of TIMER_MIN..TIMER_MAX will cancel a timer) */
-} SharedDataType;
+/* The libpeas entry point must stay visible when the plugin is built with -fvisibility=hidden
+   (--enable-fast-load), as G_MODULE_EXPORT doesn't set the visibility. */
+#ifdef __GNUC__
+__attribute__((visibility("default"))) void peas_register_types(PeasObjectModule *module);
+#endif
 
-/* Data shared between the GUI thread and the timer_function thread. */
-static SharedDataType data_shared;
-static GMutex         data_mutex;
-static GCond          data_cond;
+TOTEM_PLUGIN_REGISTER(TOTEM_TYPE_TIMER_PLUGIN, TotemTimerPlugin, totem_timer_plugin)
 
+#ifndef HAVE_TOTEM_GMENU
 /* Callbacks for timer menu item actions. */
 static void totem_timer_plugin_timerCancel    (GtkAction *action, TotemTimerPlugin *pi);
 static void totem_timer_plugin_timerAdjustable(GtkAction *action, TotemTimerPlugin *pi);
 static void totem_timer_plugin_timerFixed     (GtkAction *action, TotemTimerPlugin *pi);
+#endif
 
 /* A structure defining information related to a menu item. */
 typedef struct {
@@ -99,6 +145,7 @@ static TimerMenuItemType timerMenuItems [] = {
 #define TIMER_IDX_ADJUST      (1) /* must be index 1 */
 #define TIMER_IDX_FIXED_START (2) /* fixed timers start at index 2 */
 
+#ifndef HAVE_TOTEM_GMENU
 /* Indexes into action_entries[].  The following must not contain any gaps.
    The number of action entries is one greater than timerMenuItems because the parent (Timer menu)
    to the menu items is also an action entry. */
@@ -107,66 +154,87 @@ static TimerMenuItemType timerMenuItems [] = {
 #define ACTION_IDX_ADJUST      (2) /* menu item adjust must be index 2 */
 #define ACTION_IDX_FIXED_START (3) /* menu items for fixed timers must start at 3 */
 #define NUM_ACTION_ENTRIES     (G_N_ELEMENTS(timerMenuItems) +1)
+#endif
+
+static gboolean totem_timer_plugin_activate_deferred(TotemTimerPlugin *pi);
 
 
-/* Thread implementing the timer. */
-static void *
-timer_function(TotemObject *totem) {
-  gint64 end_time; /* absolute time when we want timer to expire */
+/* Run the deferred activation now if it hasn't run yet, e.g. when the user picks a menu item
+   before the main loop got idle. */
+static void
+totem_timer_plugin_ensure_ready(TotemTimerPlugin *pi) {
+  if (pi->priv->deferred_id) {
+    g_source_remove(pi->priv->deferred_id);
+    totem_timer_plugin_activate_deferred(pi);
+  }
+}
 
-  g_mutex_lock(&data_mutex);
 
-  do {
-    /* wait until new data arrives */
-    while (!data_shared.new) {
-      g_cond_wait(&data_cond, &data_mutex);
-    }
-    /* we have received a signal indicating new data */
-    data_shared.new = FALSE;  /* acknowledge the new data */
-
-    while ((!data_shared.terminate) && (data_shared.timeout >=  TIMER_MIN) && (data_shared.timeout <=  TIMER_MAX)) {
-      end_time = g_get_monotonic_time() + data_shared.timeout * G_TIME_SPAN_MINUTE;
-
-      while (!data_shared.new) {
-        if (!g_cond_wait_until(&data_cond, &data_mutex, end_time)) {
-          /* timeout has passed. */
-          g_mutex_unlock(&data_mutex);
-          totem_action_exit(totem);
-          return NULL; /* may not get here */
-        }
-      }
-      /* we have received a signal indicating new data */
-      data_shared.new = FALSE;  /* acknowledge the new data */
-    }
-  } while (!data_shared.terminate);
+/* Called each time a command (from any source) has started or stopped the timer. */
+static void
+totem_timer_plugin_armed_changed(TimerEngine *engine, GParamSpec *pspec, TotemTimerPlugin *pi) {
+#ifdef HAVE_TOTEM_GMENU
+  GAction *cancel_action = NULL;
+
+  /* Cancel menu item is only sensitive while a timer is running. */
+  if (pi->priv->actions) {
+    cancel_action = g_action_map_lookup_action(G_ACTION_MAP(pi->priv->actions), "cancel");
+    g_simple_action_set_enabled(G_SIMPLE_ACTION(cancel_action), timer_engine_is_armed(engine));
+  }
+#else
+  GtkAction *cancel_action = NULL;
 
-  /* the signal indicated that we should terminate */
-  g_mutex_unlock(&data_mutex);
-  g_thread_exit(NULL);
-  return NULL; /* will never get here */
+  /* Cancel menu item is only sensitive while a timer is running. */
+  if (pi->priv->action_group) {
+    cancel_action = gtk_action_group_get_action(pi->priv->action_group, timerMenuItems[TIMER_IDX_CANCEL].name);
+    gtk_action_set_sensitive(cancel_action, timer_engine_is_armed(engine));
+  }
+#endif
 }
 
 
-/* Cancel the timer. */
+/* Start the expiry: upon expiry of the timer, or when totem has been idle for too long. */
 static void
-totem_timer_plugin_timerCancel(GtkAction *action, TotemTimerPlugin *pi) {
-  GtkAction *cancel_action = NULL;
+totem_timer_plugin_run_expiry(TotemTimerPlugin *pi) {
+  timer_latency_expired();
+  timer_expiry_run(pi->priv->expiry);
+}
 
-  g_mutex_lock(&data_mutex);
-  data_shared.new       = TRUE;
-  data_shared.terminate = FALSE;
-  data_shared.timeout   = TIMER_CANCEL;
-  g_cond_signal(&data_cond);  /* hold lock before signalling */
-  g_mutex_unlock(&data_mutex);
 
-  /* Make cancel menu item insensitive. */
-  cancel_action = gtk_action_group_get_action(pi->priv->action_group, timerMenuItems[TIMER_IDX_CANCEL].name);
-  gtk_action_set_sensitive(cancel_action, FALSE);
+/* Recovery=exit of the watchdog: save the snapshot and exit, for a supervisor to restart totem.  The timer
+   didn't expire, so neither the ExpiryAction (suspend, power off) nor the exit latency apply. */
+static void
+totem_timer_plugin_watchdog_exit(TotemTimerPlugin *pi) {
+  timer_expiry_run_action(pi->priv->expiry, TIMER_EXPIRY_ACTION_EXIT);
 }
 
 
+/* totem's pipeline prerolled (see timer-qos.c): a scheduled switch got to its first frame. */
 static void
-totem_timer_plugin_timerAdjustable(GtkAction *action, TotemTimerPlugin *pi) {
+totem_timer_plugin_prerolled(TotemTimerPlugin *pi) {
+  if (pi->priv->schedule) {
+    timer_schedule_prerolled(pi->priv->schedule);
+  }
+}
+
+
+/* Called when the timer expired, either locally or in another instance sharing the timer. */
+static void
+totem_timer_plugin_expired(TimerEngine *engine, TotemTimerPlugin *pi) {
+  totem_timer_plugin_run_expiry(pi);
+}
+
+
+/* Last step of the expiry, once every stage of it has completed. */
+static void
+totem_timer_plugin_exit(TotemTimerPlugin *pi) {
+  totem_action_exit(pi->priv->totem);
+}
+
+
+/* Let the user enter a timeout and arm the timer with it. */
+static void
+totem_timer_plugin_run_dialog(TotemTimerPlugin *pi) {
   GtkWidget     *dialog;
   GtkWidget     *label;
   GtkWidget     *spinButton;
@@ -175,6 +243,8 @@ totem_timer_plugin_timerAdjustable(GtkAction *action, TotemTimerPlugin *pi) {
   GtkWidget     *reject;
   gint           response;
 
+  totem_timer_plugin_ensure_ready(pi);
+
   /* Build the dialog window */
 
   /* Add the buttons to the dialog window. */
@@ -197,7 +267,7 @@ totem_timer_plugin_timerAdjustable(GtkAction *action, TotemTimerPlugin *pi) {
 "\r\n");
 
   /* Define a spinButton. */
-  adjustment = gtk_adjustment_new(TIMER_ADJ_DEFAULT, TIMER_MIN, TIMER_MAX, 1, 10, 0);
+  adjustment = gtk_adjustment_new(timer_config_get(pi->priv->config)->default_timeout, TIMER_MIN, TIMER_MAX, 1, 10, 0);
   spinButton = gtk_spin_button_new(adjustment, 10, 0);
 
   /* Add the message and spinButton to the content_area of the dialog window. */
@@ -209,35 +279,178 @@ totem_timer_plugin_timerAdjustable(GtkAction *action, TotemTimerPlugin *pi) {
   response = gtk_dialog_run(GTK_DIALOG(dialog));
   gtk_widget_hide(dialog);
   if (GTK_RESPONSE_APPLY == response) {
-    gint       time_raw;
-    GtkAction *cancel_action = NULL;
+    gint time_raw;
 
     time_raw = gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(spinButton));
     if ((time_raw < TIMER_MIN) || (time_raw > TIMER_MAX)) {
       /* timer value extracted is out of range - (spin_button not defined properly) */
       /* handle this by using default timeout value */
-      time_raw = TIMER_ADJ_DEFAULT;
+      time_raw = timer_config_get(pi->priv->config)->default_timeout;
     }
 
-    g_mutex_lock(&data_mutex);
-    data_shared.new       = TRUE;
-    data_shared.terminate = FALSE;
-    data_shared.timeout   = (TimeType) time_raw;
-    g_cond_signal(&data_cond);  /* hold lock before signalling */
-    g_mutex_unlock(&data_mutex);
-
-    /* Make cancel menu item sensitive. */
-    cancel_action = gtk_action_group_get_action(pi->priv->action_group, timerMenuItems[TIMER_IDX_CANCEL].name);
-    gtk_action_set_sensitive(cancel_action, TRUE);
+    timer_engine_command(pi->priv->engine, TIMER_COMMAND_ARM, (TimeType) time_raw * G_TIME_SPAN_MINUTE);
   }
   gtk_widget_destroy(dialog);
 }
 
 
+/* Runs once the main loop got idle after the Timer sub-menu was asked to open, i.e. after the redraw
+   showing it (GDK redraws at a higher priority than this idle): records the time it took as menu-open-us. */
+static gboolean
+totem_timer_plugin_menu_opened(TotemTimerPlugin *pi) {
+  GTimeSpan elapsed = g_get_monotonic_time() - pi->priv->menu_opening;
+
+  pi->priv->menu_opened_id = 0;
+  timer_metrics_set("menu-open-us", elapsed);
+  g_debug("Timer: menu opened in %" G_GINT64_FORMAT " us", elapsed);
+  return G_SOURCE_REMOVE;
+}
+
+
+/* The Timer sub-menu is being opened (from either menu backend): time it until it has been drawn. */
+static void
+totem_timer_plugin_menu_opening(TotemTimerPlugin *pi) {
+  if (pi->priv->menu_opened_id) {
+    return; /* already timing it */
+  }
+  pi->priv->menu_opening   = g_get_monotonic_time();
+  pi->priv->menu_opened_id = g_idle_add_full(G_PRIORITY_DEFAULT_IDLE, (GSourceFunc) totem_timer_plugin_menu_opened, pi, NULL);
+}
+
+
+#ifdef HAVE_TOTEM_GMENU
+/* Arm the timer, the parameter being the timeout in minutes. */
+static void
+totem_timer_plugin_arm_activated(GSimpleAction *action, GVariant *parameter, TotemTimerPlugin *pi) {
+  gint32 time_raw = g_variant_get_int32(parameter);
+
+  if ((time_raw < TIMER_MIN) || (time_raw > TIMER_MAX)) {
+    return; /* timer value is out of range - (menu item defined improperly) */
+  }
+
+  totem_timer_plugin_ensure_ready(pi);
+  timer_engine_command(pi->priv->engine, TIMER_COMMAND_ARM, (TimeType) time_raw * G_TIME_SPAN_MINUTE);
+}
+
+
+static void
+totem_timer_plugin_cancel_activated(GSimpleAction *action, GVariant *parameter, TotemTimerPlugin *pi) {
+  totem_timer_plugin_ensure_ready(pi);
+  timer_engine_command(pi->priv->engine, TIMER_COMMAND_CANCEL, 0);
+}
+
+
+static void
+totem_timer_plugin_adjust_activated(GSimpleAction *action, GVariant *parameter, TotemTimerPlugin *pi) {
+  totem_timer_plugin_run_dialog(pi);
+}
+
+
+/* The Timer sub-menu is opened (TRUE) or closed (FALSE), see its "submenu-action" attribute.  GTK only
+   shows the sub-menu once the state changed. */
+static void
+totem_timer_plugin_shown_changed(GSimpleAction *action, GVariant *value, TotemTimerPlugin *pi) {
+  if (g_variant_get_boolean(value)) {
+    totem_timer_plugin_menu_opening(pi);
+  }
+  g_simple_action_set_state(action, value);
+}
+
+
+static const GActionEntry timerActionEntries [] = {
+  { "arm",    (gpointer) totem_timer_plugin_arm_activated,    "i",  NULL,    NULL },
+  { "cancel", (gpointer) totem_timer_plugin_cancel_activated, NULL, NULL,    NULL },
+  { "adjust", (gpointer) totem_timer_plugin_adjust_activated, NULL, NULL,    NULL },
+  { "shown",  NULL,                                           NULL, "false", (gpointer) totem_timer_plugin_shown_changed }
+};
+
+
+/* Build the timer's actions and a Timer sub-menu referring to them.  The sub-menu is a single
+   GMenu model, added to a menu section of totem; the menus showing that section update themselves
+   from the model without being rebuilt. */
+static void
+totem_timer_plugin_menu_install(TotemTimerPlugin *pi) {
+  TotemTimerPluginPrivate *priv = pi->priv;
+  GMenu                   *section;
+  GMenuItem               *item;
+  GAction                 *action;
+  int                      time_raw;
+  guint                    i;
+
+  priv->actions = g_simple_action_group_new();
+  g_action_map_add_action_entries(G_ACTION_MAP(priv->actions), timerActionEntries, G_N_ELEMENTS(timerActionEntries), pi);
+  gtk_widget_insert_action_group(GTK_WIDGET(totem_get_main_window(priv->totem)), ACTION_PREFIX, G_ACTION_GROUP(priv->actions));
+
+  /* Cancel menu item is only sensitive while a timer is running (none before the deferred activation). */
+  action = g_action_map_lookup_action(G_ACTION_MAP(priv->actions), "cancel");
+  g_simple_action_set_enabled(G_SIMPLE_ACTION(action), priv->engine && timer_engine_is_armed(priv->engine));
+
+  priv->menu = g_menu_new();
+  g_menu_append(priv->menu, timerMenuItems[TIMER_IDX_CANCEL].name, ACTION_PREFIX ".cancel");
+  g_menu_append(priv->menu, timerMenuItems[TIMER_IDX_ADJUST].name, ACTION_PREFIX ".adjust");
+  for (i=TIMER_IDX_FIXED_START; i<G_N_ELEMENTS(timerMenuItems); i++) {
+    if (1 != sscanf(timerMenuItems[i].name, "%3dm", &time_raw)) {
+      continue; /* couldn't extract timer value from menu item name - (timerMenuItems[] is defined improperly) */
+    }
+    item = g_menu_item_new(timerMenuItems[i].name, NULL);
+    g_menu_item_set_action_and_target_value(item, ACTION_PREFIX ".arm", g_variant_new_int32(time_raw));
+    g_menu_append_item(priv->menu, item);
+    g_object_unref(item);
+  }
+
+  /* the state of "shown" follows the sub-menu being open, which times its opening */
+  section = totem_object_get_menu_section(priv->totem, MENU_SECTION);
+  item    = g_menu_item_new_submenu(ACTION_NAME, G_MENU_MODEL(priv->menu));
+  g_menu_item_set_attribute(item, "submenu-action", "s", ACTION_PREFIX ".shown");
+  g_menu_append_item(section, item);
+  g_object_unref(item);
+}
+
+
+static void
+totem_timer_plugin_menu_remove(TotemTimerPlugin *pi) {
+  TotemTimerPluginPrivate *priv = pi->priv;
+  GMenu                   *section;
+  GMenuModel              *submenu;
+  gint                     i;
+
+  /* Remove only our sub-menu, the section is shared with other plugins. */
+  section = totem_object_get_menu_section(priv->totem, MENU_SECTION);
+  for (i=g_menu_model_get_n_items(G_MENU_MODEL(section)) -1; i>=0; i--) {
+    submenu = g_menu_model_get_item_link(G_MENU_MODEL(section), i, G_MENU_LINK_SUBMENU);
+    if (submenu) {
+      g_object_unref(submenu);
+      if (submenu == G_MENU_MODEL(priv->menu)) {
+        g_menu_remove(section, i);
+        break;
+      }
+    }
+  }
+  g_clear_object(&priv->menu);
+
+  gtk_widget_insert_action_group(GTK_WIDGET(totem_get_main_window(priv->totem)), ACTION_PREFIX, NULL);
+  g_clear_object(&priv->actions);
+}
+
+#else /* !HAVE_TOTEM_GMENU */
+
+/* Cancel the timer. */
+static void
+totem_timer_plugin_timerCancel(GtkAction *action, TotemTimerPlugin *pi) {
+  totem_timer_plugin_ensure_ready(pi);
+  timer_engine_command(pi->priv->engine, TIMER_COMMAND_CANCEL, 0);
+}
+
+
+static void
+totem_timer_plugin_timerAdjustable(GtkAction *action, TotemTimerPlugin *pi) {
+  totem_timer_plugin_run_dialog(pi);
+}
+
+
 static void
 totem_timer_plugin_timerFixed(GtkAction *action, TotemTimerPlugin *pi) {
-  int        time_raw      = 0;    /* as extracted by sscanf */
-  GtkAction *cancel_action = NULL;
+  int time_raw = 0; /* as extracted by sscanf */
 
   if (1 != sscanf(gtk_action_get_name(action), "%3dm", &time_raw)) {
     return; /* couldn't extract timer value from menu item name - (timerMenuItems[] is defined improperly) */
@@ -247,34 +460,38 @@ totem_timer_plugin_timerFixed(GtkAction *action, TotemTimerPlugin *pi) {
     return; /* timer value extracted is out of range - (timerMenuItems[] is defined improperly) */
   }
 
-  g_mutex_lock(&data_mutex);
-  data_shared.new       = TRUE;
-  data_shared.terminate = FALSE;
-  data_shared.timeout   = (TimeType) time_raw;
-  g_cond_signal(&data_cond);  /* hold lock before signalling */
-  g_mutex_unlock(&data_mutex);
+  totem_timer_plugin_ensure_ready(pi);
+  timer_engine_command(pi->priv->engine, TIMER_COMMAND_ARM, (TimeType) time_raw * G_TIME_SPAN_MINUTE);
+}
+
+
+/* Paths of the Timer menus merged into the menu bar and the pop-up menu. */
+static const gchar *timerMenuPaths [] = {
+  "/ui/tmw-menubar/movie/save-placeholder/"ACTION_NAME,
+  "/ui/totem-main-popup/save-placeholder/"ACTION_NAME
+};
+
+
+/* Returns the sub-menu of the menu item at path, NULL if none. */
+static GtkWidget *
+totem_timer_plugin_get_submenu(GtkUIManager *ui_manager, const gchar *path) {
+  GtkWidget *item = gtk_ui_manager_get_widget(ui_manager, path);
 
-  /* Make cancel menu item sensitive. */
-  cancel_action = gtk_action_group_get_action(pi->priv->action_group, timerMenuItems[TIMER_IDX_CANCEL].name);
-  gtk_action_set_sensitive(cancel_action, TRUE);
+  return GTK_IS_MENU_ITEM(item) ? gtk_menu_item_get_submenu(GTK_MENU_ITEM(item)) : NULL;
 }
 
 
-/* Called when the plugin is activated.
-   Totem calls this when either the user activates the plugin,
-   or when totem starts up with the plugin already configured as active. */
+/* Build the Timer menu from timerMenuItems[] and merge it into the menu bar and the pop-up menu. */
 static void
-impl_activate(PeasActivatable *plugin) {
-  TotemTimerPlugin        *pi           = TOTEM_TIMER_PLUGIN(plugin);
+totem_timer_plugin_menu_install(TotemTimerPlugin *pi) {
   TotemTimerPluginPrivate *priv         = pi->priv;
   GtkActionEntry          *action_entry = NULL;
   GtkUIManager            *ui_manager   = NULL;
   GtkAction               *action       = NULL;
+  GtkWidget               *submenu      = NULL;
   guint                    i;
   guint                    j;
 
-  priv->totem = g_object_get_data(G_OBJECT(plugin), "object");
-
   /* Build priv->action_entries[]. */
   priv->action_entries = g_malloc(NUM_ACTION_ENTRIES * sizeof(GtkActionEntry));
 
@@ -312,7 +529,6 @@ impl_activate(PeasActivatable *plugin) {
     action_entry->label       = timerMenuItems[j].name;
   }
 
-  /* Create the GUI */
   priv->action_group = gtk_action_group_new(ACTION_GROUP);
   gtk_action_group_add_actions(priv->action_group,
                                priv->action_entries,
@@ -366,47 +582,316 @@ impl_activate(PeasActivatable *plugin) {
   action = gtk_action_group_get_action(priv->action_group, ACTION_NAME);
   gtk_action_set_sensitive(action, TRUE);
 
-  /* Make cancel menu item insensitive. */
+  /* Cancel menu item is only sensitive while a timer is running (none before the deferred activation). */
   action = gtk_action_group_get_action(priv->action_group, timerMenuItems[TIMER_IDX_CANCEL].name);
-  gtk_action_set_sensitive(action, FALSE);
-
-  /* Make sure shared data is in sane state before starting timer thread. */
-  data_shared.new       = FALSE;
-  data_shared.terminate = FALSE;
-  data_shared.timeout   = TIMER_CANCEL;
+  gtk_action_set_sensitive(action, priv->engine && timer_engine_is_armed(priv->engine));
 
-  priv->timer_thread = g_thread_new("tTimerThread", (GThreadFunc) timer_function, (gpointer) priv->totem);
-  if (!priv->timer_thread) {
-    /* actually will not get here, g_thread_new() causes program abort if thread can not be created */
-    return;
+  /* Time the opening of the Timer sub-menus. */
+  for (i=0; i<G_N_ELEMENTS(timerMenuPaths); i++) {
+    submenu = totem_timer_plugin_get_submenu(ui_manager, timerMenuPaths[i]);
+    if (submenu) {
+      g_signal_connect_swapped(submenu, "show", G_CALLBACK(totem_timer_plugin_menu_opening), pi);
+    }
   }
 }
 
 
-/* Called when the plugin is activated.
-   Totem calls this when either the user deactivates the plugin,
-   or when totem exits with the plugin configured as active. */
 static void
-impl_deactivate(PeasActivatable *plugin) {
-  TotemTimerPlugin        *pi         = TOTEM_TIMER_PLUGIN(plugin);
+totem_timer_plugin_menu_remove(TotemTimerPlugin *pi) {
   TotemTimerPluginPrivate *priv       = pi->priv;
   GtkUIManager            *ui_manager = NULL;
-
-  /* Tell the timer thread to exit gracefully. */
-  g_mutex_lock(&data_mutex);
-  data_shared.new       = TRUE;
-  data_shared.terminate = TRUE;
-  data_shared.timeout   = TIMER_CANCEL;  /* not used */
-  g_cond_signal(&data_cond);  /* hold lock before signalling */
-  g_mutex_unlock(&data_mutex);
-  g_thread_join(priv->timer_thread);  /* g_thread_join() also does a g_thread_unref() too */
+  GtkWidget               *submenu    = NULL;
+  guint                    i;
 
   ui_manager = totem_get_ui_manager(priv->totem);
+  for (i=0; i<G_N_ELEMENTS(timerMenuPaths); i++) {
+    submenu = totem_timer_plugin_get_submenu(ui_manager, timerMenuPaths[i]);
+    if (submenu) {
+      g_signal_handlers_disconnect_by_data(submenu, pi);
+    }
+  }
   gtk_ui_manager_remove_ui(ui_manager, priv->ui_merge_id);
   gtk_ui_manager_remove_action_group(ui_manager, priv->action_group);
-
-  priv->totem = NULL;
+  priv->action_group = NULL;
 
   g_free(priv->action_entries);
   priv->action_entries = NULL;
 }
+
+#endif /* HAVE_TOTEM_GMENU */
+
+
+/* Create, reconfigure or free the optional features keeping a TimerEngine of their own, as settings enable
+   them, so that a disabled feature doesn't even have a timer thread.  priv->netclock must exist. */
+static void
+totem_timer_plugin_features_configure(TotemTimerPlugin *pi, const TimerSettings *settings) {
+  TotemTimerPluginPrivate *priv = pi->priv;
+
+  /* Recover a playback that got stuck, if asked to. */
+  if ((settings->watchdog_budget > 0) && !priv->watchdog) {
+    priv->watchdog = timer_watchdog_new(settings, priv->totem, (TimerWatchdogFunc) totem_timer_plugin_watchdog_exit, pi);
+  } else if (settings->watchdog_budget > 0) {
+    timer_watchdog_configure(priv->watchdog, settings);
+  } else if (priv->watchdog) {
+    timer_watchdog_free(priv->watchdog);
+    priv->watchdog = NULL;
+  }
+
+  /* Move on to the next item once the current one played long enough, if asked to. */
+  if ((settings->dwell_rules->len > 0) && !priv->dwell) {
+    priv->dwell = timer_dwell_new(settings, priv->totem);
+  } else if (settings->dwell_rules->len > 0) {
+    timer_dwell_configure(priv->dwell, settings);
+  } else if (priv->dwell) {
+    timer_dwell_free(priv->dwell);
+    priv->dwell = NULL;
+  }
+
+  /* Switch the playlist at set times of day, if asked to, referring the times to the shared clock (if any). */
+  if ((settings->schedule->len > 0) && !priv->schedule) {
+    priv->schedule = timer_schedule_new(settings, priv->totem);
+    timer_netclock_add_engine(priv->netclock, timer_schedule_get_engine(priv->schedule));
+  } else if (settings->schedule->len > 0) {
+    timer_schedule_configure(priv->schedule, settings);
+  } else if (priv->schedule) {
+    timer_netclock_remove_engine(priv->netclock, timer_schedule_get_engine(priv->schedule));
+    timer_schedule_free(priv->schedule);
+    priv->schedule = NULL;
+  }
+}
+
+
+/* Called when the settings file changed, to apply the new settings. */
+static void
+totem_timer_plugin_settings_changed(const TimerSettings *settings, TotemTimerPlugin *pi) {
+  TotemTimerPluginPrivate *priv = pi->priv;
+
+  timer_engine_set_slack(priv->engine, settings->slack);
+  timer_engine_set_advance(priv->engine, settings->compensate_latency ? priv->exit_latency : 0);
+  timer_expiry_configure(priv->expiry, settings);
+  timer_logind_configure(priv->logind, settings);
+  timer_prestop_configure(priv->prestop, settings);
+  timer_idle_configure(priv->idle, settings);
+  timer_netclock_configure(priv->netclock, settings);
+  totem_timer_plugin_features_configure(pi, settings);
+
+  timer_signals_remove(priv->signals);
+  priv->signals = timer_signals_install(settings, priv->engine);
+
+  if (settings->shared && !priv->sync) {
+    priv->sync = timer_sync_new(priv->engine);
+  } else if (!settings->shared && priv->sync) {
+    timer_sync_free(priv->sync);
+    priv->sync = NULL;
+  }
+}
+
+
+/* Second phase of the activation, run from a low-priority idle once totem has shown its main window
+   (or earlier, through totem_timer_plugin_ensure_ready()): everything the first frame doesn't need. */
+static gboolean
+totem_timer_plugin_activate_deferred(TotemTimerPlugin *pi) {
+  TotemTimerPluginPrivate *priv           = pi->priv;
+  gint64                   deferred_start = g_get_monotonic_time();
+  const TimerSettings     *settings;
+
+  priv->deferred_id = 0;
+  timer_metrics_set("activate-deferred-delay-us", deferred_start - priv->activated);
+
+  priv->config   = timer_config_new((TimerConfigChangedFunc) totem_timer_plugin_settings_changed, pi);
+  settings       = timer_config_get(priv->config);
+
+  /* Upon expiry, save the session before exiting. */
+  priv->expiry   = timer_expiry_new(settings, (TimerExpiryFunc) totem_timer_plugin_exit, pi);
+  priv->snapshot = timer_snapshot_new(priv->totem);
+  timer_expiry_add_stage(priv->expiry, "snapshot", (TimerExpiryStageFunc) timer_snapshot_stage, priv->snapshot);
+
+  priv->engine   = timer_engine_new();
+  timer_engine_set_slack(priv->engine, settings->slack);
+  /* Expire early enough for totem to be gone at the deadline, if asked to. */
+  priv->exit_latency = timer_latency_get_estimate();
+  timer_engine_set_advance(priv->engine, settings->compensate_latency ? priv->exit_latency : 0);
+  g_signal_connect(priv->engine, "notify::armed", G_CALLBACK(totem_timer_plugin_armed_changed), pi);
+  /* connected after, so that the other handlers (e.g. TimerSync) see the expiry before totem exits */
+  g_signal_connect_after(priv->engine, "expired", G_CALLBACK(totem_timer_plugin_expired), pi);
+
+  /* Stop the playback ahead of the deadline, if asked to, for a quick exit. */
+  priv->prestop  = timer_prestop_new(settings, priv->engine, priv->totem);
+
+  /* Exit once totem has sat idle for too long, if asked to, whether or not the timer runs. */
+  priv->idle     = timer_idle_new(settings, priv->totem, (TimerIdleFunc) totem_timer_plugin_run_expiry, pi);
+
+  /* Refer the deadlines to a clock shared with other machines, if asked to. */
+  priv->netclock = timer_netclock_new(settings, priv->engine);
+
+  /* Watchdog, dwell and schedule, if asked to. */
+  totem_timer_plugin_features_configure(pi, settings);
+
+  /* Count the frames rendered and dropped by the playback, reported with the metrics. */
+  priv->qos      = timer_qos_new((TimerQosFunc) totem_timer_plugin_prerolled, pi);
+
+  /* Share the timer with other totem instances, adopting a timer they already armed. */
+  if (settings->shared) {
+    priv->sync = timer_sync_new(priv->engine);
+  }
+
+  /* Arm the timer requested by the environment (if any), a duration counting from the activation. */
+  if (priv->startup_deadline && (priv->startup_command == TIMER_COMMAND_ARM_AT)) {
+    timer_engine_command(priv->engine, TIMER_COMMAND_ARM_AT, priv->startup_deadline);
+  } else if (priv->startup_deadline) {
+    timer_engine_command(priv->engine, TIMER_COMMAND_ARM, MAX(priv->startup_deadline - g_get_monotonic_time(), 1));
+  }
+  priv->startup_deadline = 0;
+
+  /* Allow the timer to be controlled over D-Bus and through POSIX signals. */
+  priv->dbus    = timer_dbus_export(priv->engine, priv->instance);
+  priv->signals = timer_signals_install(settings, priv->engine);
+
+  /* Publish the state of the timer for external monitors. */
+  priv->status  = timer_status_new(priv->engine, priv->instance);
+
+  /* Keep the timer meaningful across suspend/resume of the machine. */
+  priv->logind  = timer_logind_watch(settings, priv->engine);
+
+  /* Let other plugins (including Python ones, through introspection) use the timer. */
+  timer_engine_attach(priv->engine, G_OBJECT(priv->totem));
+
+  /* The menu was built before the timer existed. */
+  totem_timer_plugin_armed_changed(priv->engine, NULL, pi);
+
+  timer_metrics_set("activate-deferred-us", g_get_monotonic_time() - deferred_start);
+  g_debug("Timer: deferred activation ran %" G_GINT64_FORMAT " us after the activation, in %" G_GINT64_FORMAT " us",
+          deferred_start - priv->activated, g_get_monotonic_time() - deferred_start);
+  return G_SOURCE_REMOVE;
+}
+
+
+/* Called when the plugin is activated.
+   Totem calls this when either the user activates the plugin,
+   or when totem starts up with the plugin already configured as active.
+   Only the menu is built here, as totem activates its plugins before showing its main window;
+   the rest of the activation is deferred (see totem_timer_plugin_activate_deferred()). */
+static void
+impl_activate(PeasActivatable *plugin) {
+  TotemTimerPlugin        *pi              = TOTEM_TIMER_PLUGIN(plugin);
+  TotemTimerPluginPrivate *priv            = pi->priv;
+  gint64                   startup_value;
+  static gboolean          module_pinned   = FALSE;
+
+  priv->activated = g_get_monotonic_time();
+
+  /* TimerEngine is a static type living in this module, so the module must never be unloaded. */
+  if (!module_pinned) {
+    g_type_module_use(G_TYPE_MODULE(g_type_get_plugin(TOTEM_TYPE_TIMER_PLUGIN)));
+    module_pinned = TRUE;
+  }
+
+  priv->totem = g_object_get_data(G_OBJECT(plugin), "object");
+
+  /* the lowest free index, so that re-activating a single instance gets the resources of the process again */
+  priv->instance = 0;
+  while ((priv->instance < 31) && (activeInstances & (1u << priv->instance))) {
+    priv->instance++;
+  }
+  activeInstances |= 1u << priv->instance;
+
+  /* A timeout requested by the environment (if any) runs from now, not from the deferred activation. */
+  priv->startup_deadline = 0;
+  if (timer_settings_get_startup(&priv->startup_command, &startup_value)) {
+    priv->startup_deadline = (priv->startup_command == TIMER_COMMAND_ARM) ? priv->activated + startup_value : startup_value;
+  }
+
+  /* Create the GUI */
+  totem_timer_plugin_menu_install(pi);
+
+  priv->deferred_id = g_idle_add_full(G_PRIORITY_LOW, (GSourceFunc) totem_timer_plugin_activate_deferred, pi, NULL);
+
+  timer_metrics_set("activate-critical-us", g_get_monotonic_time() - priv->activated);
+  g_debug("Timer: activated in %" G_GINT64_FORMAT " us", g_get_monotonic_time() - priv->activated);
+}
+
+
+/* Called when the plugin is activated.
+   Totem calls this when either the user deactivates the plugin,
+   or when totem exits with the plugin configured as active. */
+static void
+impl_deactivate(PeasActivatable *plugin) {
+  TotemTimerPlugin        *pi   = TOTEM_TIMER_PLUGIN(plugin);
+  TotemTimerPluginPrivate *priv = pi->priv;
+
+  if (priv->deferred_id) {
+    /* deactivated before the deferred activation ran: only the menu exists */
+    g_source_remove(priv->deferred_id);
+    priv->deferred_id = 0;
+  } else {
+    timer_engine_detach(priv->engine, G_OBJECT(priv->totem));
+
+    timer_logind_unwatch(priv->logind);
+    priv->logind = NULL;
+
+    timer_signals_remove(priv->signals);
+    priv->signals = NULL;
+
+    timer_status_free(priv->status);
+    priv->status = NULL;
+
+    timer_prestop_free(priv->prestop);
+    priv->prestop = NULL;
+
+    timer_idle_free(priv->idle);
+    priv->idle = NULL;
+
+    if (priv->watchdog) {
+      timer_watchdog_free(priv->watchdog);
+      priv->watchdog = NULL;
+    }
+
+    if (priv->dwell) {
+      timer_dwell_free(priv->dwell);
+      priv->dwell = NULL;
+    }
+
+    timer_qos_free(priv->qos);
+    priv->qos = NULL;
+
+    /* before the engines it refers to the shared clock */
+    timer_netclock_free(priv->netclock);
+    priv->netclock = NULL;
+
+    if (priv->schedule) {
+      timer_schedule_free(priv->schedule);
+      priv->schedule = NULL;
+    }
+
+    timer_dbus_unexport(priv->dbus);
+    priv->dbus = NULL;
+
+    if (priv->sync) {
+      timer_sync_free(priv->sync);
+      priv->sync = NULL;
+    }
+
+    /* Tell the timer thread to exit gracefully (once no other plugin holds the engine). */
+    g_signal_handlers_disconnect_by_data(priv->engine, pi);
+    g_object_unref(priv->engine);
+    priv->engine = NULL;
+
+    timer_snapshot_free(priv->snapshot);
+    priv->snapshot = NULL;
+
+    timer_expiry_free(priv->expiry);
+    priv->expiry = NULL;
+
+    timer_config_free(priv->config);
+    priv->config = NULL;
+  }
+
+  totem_timer_plugin_menu_remove(pi);
+  if (priv->menu_opened_id) {
+    g_source_remove(priv->menu_opened_id);
+    priv->menu_opened_id = 0;
+  }
+
+  activeInstances &= ~(1u << priv->instance);
+  priv->totem = NULL;
+}